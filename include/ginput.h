@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <gimxpoll/include/gpoll.h>
+#include <gimxtime/include/gtime.h>
 
 #define GE_MAX_DEVICES 256
 
@@ -306,8 +307,20 @@ typedef enum {
        GE_JOYDAMPERFORCE,     /**< Joystick damper force */
        GE_JOYSINEFORCE,     /**< Joystick sine force */
        GE_QUIT,
+       GE_JOYDEVICEADDED,     /**< Joystick plugged after initialization (hotplug) */
+       GE_JOYDEVICEREMOVED,     /**< Joystick unplugged (hotplug) */
+       GE_MOUSEDEVICEADDED,     /**< Mouse plugged after initialization (hotplug) */
+       GE_MOUSEDEVICEREMOVED,     /**< Mouse unplugged (hotplug) */
+       GE_KEYBOARDDEVICEADDED,     /**< Keyboard plugged after initialization (hotplug) */
+       GE_KEYBOARDDEVICEREMOVED,     /**< Keyboard unplugged (hotplug) */
 } GE_EventType;
 
+/*
+ * Event masks, to select the event types that are delivered for a device type or a device.
+ */
+#define GE_EVENT_MASK(TYPE) (1U << (TYPE))
+#define GE_EVENT_MASK_ALL 0xffffffffU
+
 typedef struct GE_KeyboardEvent {
   uint8_t type; /**< GE_KEYDOWN or GE_KEYUP */
   uint8_t which;  /**< The keyboard device index */
@@ -334,6 +347,16 @@ typedef struct GE_JoyAxisEvent {
   int16_t value; /**< The axis value (range: -32768 to 32767) */
 } GE_JoyAxisEvent;
 
+#define GE_HAT_CENTERED  0x00
+#define GE_HAT_UP        0x01
+#define GE_HAT_RIGHT     0x02
+#define GE_HAT_DOWN      0x04
+#define GE_HAT_LEFT      0x08
+#define GE_HAT_RIGHTUP   (GE_HAT_RIGHT | GE_HAT_UP)
+#define GE_HAT_RIGHTDOWN (GE_HAT_RIGHT | GE_HAT_DOWN)
+#define GE_HAT_LEFTUP    (GE_HAT_LEFT | GE_HAT_UP)
+#define GE_HAT_LEFTDOWN  (GE_HAT_LEFT | GE_HAT_DOWN)
+
 typedef struct GE_JoyHatEvent {
   uint8_t type; /**< GE_JOYHATMOTION */
   uint8_t which;  /**< The joystick device index */
@@ -392,6 +415,11 @@ typedef struct GE_JoyPeriodicForceEvent {
   } sine;
 } GE_JoyPeriodicForceEvent;
 
+typedef struct GE_DeviceEvent {
+  uint8_t type;     /**< GE_JOYDEVICEADDED, GE_JOYDEVICEREMOVED, GE_MOUSEDEVICEADDED... */
+  uint8_t which;  /**< The device index */
+} GE_DeviceEvent;
+
 typedef union GE_Event {
   struct
   {
@@ -408,6 +436,7 @@ typedef union GE_Event {
   GE_JoyConstantForceEvent jconstant;
   GE_JoyConditionForceEvent jcondition;
   GE_JoyPeriodicForceEvent jperiodic;
+  GE_DeviceEvent device;
 } GE_Event;
 
 typedef enum
@@ -426,6 +455,120 @@ typedef enum
   GE_MK_MODE_SINGLE_INPUT
 } GE_MK_Mode;
 
+typedef enum
+{
+  GE_MOTION_FRAME, /**< One mouse motion event per device report (default) */
+  GE_MOTION_READ,  /**< One mouse motion event per read, summing all the reports read at once */
+} GE_MotionMode;
+
+typedef enum
+{
+  GE_HAT_MODE_BUTTONS, /**< Hat directions are reported as joystick buttons, 4 per hat, after the physical buttons (default) */
+  GE_HAT_MODE_NATIVE,  /**< Hats are reported as GE_JOYHATMOTION events */
+} GE_HatMode;
+
+typedef enum
+{
+  GE_JOYSTICK_BACKEND_JS,    /**< The legacy joystick interface (/dev/input/jsX), with the event device for force feedback (default) */
+  GE_JOYSTICK_BACKEND_EVDEV, /**< The event devices (/dev/input/eventX), for both input and force feedback */
+} GE_JoystickBackend;
+
+typedef enum
+{
+  GE_REPLAY_REALTIME, /**< Play the capture at its original speed */
+  GE_REPLAY_FAST,     /**< Play the capture as fast as possible */
+} GE_ReplayMode;
+
+typedef enum
+{
+  GE_QUEUE_SINGLE_PRODUCER, /**< Only one thread calls ginput_queue_push (default) */
+  GE_QUEUE_MULTI_PRODUCER   /**< Several threads may call ginput_queue_push concurrently */
+} GE_QueueMode;
+
+typedef enum
+{
+  GE_DEVICE_JOYSTICK,
+  GE_DEVICE_MOUSE,
+  GE_DEVICE_KEYBOARD,
+} GE_DeviceType;
+
+/*
+ * Log-linear histogram: values below 16 have their own bucket,
+ * then each power of two is split into 8 buckets (12.5% resolution).
+ */
+#define GE_HISTOGRAM_BUCKETS 496
+
+typedef struct
+{
+  uint64_t count; /**< Number of recorded values */
+  uint64_t sum;   /**< Sum of the recorded values */
+  uint64_t max;   /**< Max recorded value */
+  uint64_t buckets[GE_HISTOGRAM_BUCKETS];
+} GE_Histogram;
+
+typedef struct
+{
+  uint64_t reads;  /**< Number of successful reads */
+  uint64_t eagain; /**< Number of reads that returned EAGAIN (spurious wakeups) */
+  uint64_t inputs; /**< Number of input records read (js_event, input_event or HID report) */
+  GE_Histogram read_size;        /**< Input records per read */
+  GE_Histogram event_to_read;    /**< Nanoseconds from the event timestamp to the read return (evdev devices only) */
+  GE_Histogram read_to_callback; /**< Nanoseconds from the read return until the event callback(s) returned */
+} GE_Stats;
+
+#define GE_JOYSTICK_AXES_MAX 256
+#define GE_JOYSTICK_BUTTONS_MAX 256
+#define GE_JOYSTICK_HATS_MAX 256
+#define GE_KEYS_MAX 0x300 // the key codes of all the sources (KEY_CNT on GNU/Linux)
+
+/*
+ * The current state of a device, built from its events (see ginput_joystick_snapshot).
+ */
+typedef struct
+{
+  gtime timestamp;                          /**< The timestamp of the last event, or 0 if there was none */
+  int16_t axes[GE_JOYSTICK_AXES_MAX];       /**< The axis values */
+  uint8_t buttons[GE_JOYSTICK_BUTTONS_MAX]; /**< 1 if the button is pressed, 0 otherwise */
+  uint8_t hats[GE_JOYSTICK_HATS_MAX];       /**< The hat values (GE_HAT_*), only updated in GE_HAT_MODE_NATIVE */
+} GE_JoystickState;
+
+typedef struct
+{
+  gtime timestamp;                        /**< The timestamp of the last event, or 0 if there was none */
+  int32_t x;                              /**< The sum of the relative motions in the X direction */
+  int32_t y;                              /**< The sum of the relative motions in the Y direction */
+  uint8_t buttons[GE_MOUSE_BUTTONS_MAX];  /**< 1 if the button is pressed, 0 otherwise */
+} GE_MouseState;
+
+typedef struct
+{
+  gtime timestamp;            /**< The timestamp of the last event, or 0 if there was none */
+  uint8_t keys[GE_KEYS_MAX];  /**< 1 if the key is pressed, 0 otherwise, indexed by key code */
+} GE_KeyboardState;
+
+/*
+ * An event read from the shared-memory event ring (Linux only).
+ */
+typedef struct
+{
+  uint64_t seq;      /**< Sequence number, incremented by one for each event; a gap means events were lost */
+  gtime timestamp;   /**< The event timestamp (see ginput_event_timestamp), or 0 if not available */
+  GE_Event event;
+} GE_ShmEvent;
+
+typedef struct GE_ShmRing GE_ShmRing;
+
+/*
+ * The reader thread settings (Linux only).
+ */
+typedef struct
+{
+  int priority;            /**< SCHED_FIFO priority of the reader thread, or 0 to keep the default policy */
+  int cpu;                 /**< The CPU the reader thread is pinned to, or -1 */
+  int lock_memory;         /**< Lock the process memory (mlockall), to avoid page faults */
+  unsigned int queue_size; /**< The max number of events waiting for ginput_dispatch, or 0 for the default (1024) */
+} GE_ReaderConfig;
+
 #define EVENT_BUFFER_SIZE 256
 
 #define AXIS_X 0
@@ -441,7 +584,8 @@ extern "C" {
 /*
  * \bried Initializes the library.
  *
- * \param poll_interface  the poll interface (register and remove functions)
+ * \param poll_interface  the poll interface (register and remove functions),
+ *                        or NULL to use the internal event loop (Linux only, see ginput_dispatch)
  * \param mkb_src         GE_MKB_SOURCE_PHYSICAL: use evdev under Linux and raw inputs under Windows.
  *                        GE_MKB_SOURCE_WINDOW_SYSTEM: use X inputs under Linux and the SDL library under Windows.
  * \param callback        the callback to process input events (cannot be NULL)
@@ -451,6 +595,38 @@ extern "C" {
  */
 int ginput_init(const GPOLL_INTERFACE * poll_interface, unsigned char mkb_src, int(*callback)(GE_Event*));
 
+/*
+ * \brief Initializes the library, with a callback that receives the input events in batches.
+ *        Events are buffered while a device read is processed, and delivered in a single call
+ *        once the read is complete (at most 256 events per call).
+ *        The events reported while the callback runs (e.g. GE_JOYDEVICEREMOVED when it closes
+ *        a joystick) are delivered in another call, once it returns.
+ *        The value returned by the callback is ignored.
+ *
+ * \param poll_interface  see ginput_init
+ * \param mkb_src         see ginput_init
+ * \param callback        the callback to process input events (cannot be NULL)
+ *
+ * \return 0 in case of success, -1 in case of error.
+ */
+int ginput_init_batch(const GPOLL_INTERFACE * poll_interface, unsigned char mkb_src, int(*callback)(const GE_Event * events, unsigned int count));
+
+/*
+ * \brief Enable or disable device hotplug (disabled by default). This function is Linux-specific.
+ *        When enabled, devices plugged after ginput_init are opened and reported with
+ *        GE_JOYDEVICEADDED, GE_MOUSEDEVICEADDED or GE_KEYBOARDDEVICEADDED events, and unplugged
+ *        devices are reported with the matching *REMOVED events.
+ *        A device that is plugged again gets back the index and the virtual id it had before.
+ *        The device name remains available after the device is removed.
+ *
+ * \remark This function has to be called before calling ginput_init.
+ *
+ * \param enable  1 to enable hotplug, 0 to disable it
+ *
+ * \return 0 in case of success, -1 in case of error or if the library was already initialized.
+ */
+int ginput_set_hotplug(int enable);
+
 /*
  * \brief Grab/Release the mouse cursor (Windows) or grab/release all keyboard and mouse event devices (Linux).
  *
@@ -541,6 +717,39 @@ const char * ginput_joystick_name(int id);
  */
 int ginput_joystick_virtual_id(int id);
 
+/*
+ * \brief Get the joystick index for a given name and virtual id.
+ *
+ * \param name        the joystick name, as returned by ginput_joystick_name
+ * \param virtual_id  the joystick virtual id
+ *
+ * \return the joystick index if the joystick is known, -1 otherwise.
+ *         A joystick that is unplugged keeps its index, and gets it back if it is plugged again.
+ */
+int ginput_joystick_id(const char * name, int virtual_id);
+
+/*
+ * \brief Get the mouse index for a given name and virtual id.
+ *
+ * \param name        the mouse name
+ * \param virtual_id  the mouse virtual id
+ *
+ * \return the mouse index if the mouse is known, -1 otherwise.
+ *         A mouse that is unplugged keeps its index, and gets it back if it is plugged again.
+ */
+int ginput_mouse_id(const char * name, int virtual_id);
+
+/*
+ * \brief Get the keyboard index for a given name and virtual id.
+ *
+ * \param name        the keyboard name
+ * \param virtual_id  the keyboard virtual id
+ *
+ * \return the keyboard index if the keyboard is known, -1 otherwise.
+ *         A keyboard that is unplugged keeps its index, and gets it back if it is plugged again.
+ */
+int ginput_keyboard_id(const char * name, int virtual_id);
+
 /*
  * \brief Set a joystick to the "used" state, so that a call to ginput_release_unused will keep it open.
  *
@@ -562,6 +771,141 @@ void ginput_set_joystick_used(int id);
  */
 int ginput_register_joystick(const char* name, unsigned int haptic, int (*haptic_cb)(const GE_Event * event));
 
+/*
+ * \brief Get the source timestamp of an event.
+ *        For evdev devices this is the kernel timestamp, for other sources this is the time
+ *        at which the event was read.
+ *
+ * \remark This function has to be called from the event callback (or the batch callback).
+ *
+ * \param event  the event passed to the callback
+ *
+ * \return the timestamp (gtime_gettime() time base), or 0 if it is not available.
+ */
+gtime ginput_event_timestamp(const GE_Event * event);
+
+/*
+ * \brief Get the time elapsed since an event was generated.
+ *
+ * \remark This function has to be called from the event callback (or the batch callback).
+ *
+ * \param event  the event passed to the callback
+ *
+ * \return the latency in nanoseconds, or 0 if the event timestamp is not available.
+ */
+gtime ginput_event_latency(const GE_Event * event);
+
+/*
+ * \brief Get the statistics of a device.
+ *        Statistics are only recorded if the library was built with STATS=1,
+ *        otherwise they have no overhead and this function always fails.
+ *
+ * \remark This function can be called from any thread, while events are being processed.
+ *
+ * \param type   the device type
+ * \param id     the device index
+ * \param stats  where to store the statistics
+ *
+ * \return 0 in case of success, -1 in case of error (statistics not available).
+ */
+int ginput_get_stats(GE_DeviceType type, int id, GE_Stats * stats);
+
+/*
+ * \brief Get the number of times the kernel event queue of a device overflowed (SYN_DROPPED).
+ *        The events that were lost are recovered by reading the device state, so that no key
+ *        or button is left pressed, but relative motion is lost. An increasing count means
+ *        that the device is not read fast enough.
+ *        This is only available for the evdev devices (mice, keyboards, and joysticks read
+ *        by the evdev backend), and the count is always 0 with the js backend.
+ *
+ * \remark This function can be called from any thread, while events are being processed.
+ *
+ * \param type       the device type
+ * \param id         the device index
+ * \param overflows  where to store the overflow count
+ *
+ * \return 0 in case of success, -1 in case of error (not available).
+ */
+int ginput_get_overflows(GE_DeviceType type, int id, uint64_t * overflows);
+
+/*
+ * \brief Select the event types that are delivered for all devices of a type.
+ *        Filtered events are dropped by the sources before being translated, and are not
+ *        reflected in the device snapshots. Evdev devices also ask the kernel to drop their
+ *        input when possible (EVIOCSMASK), so that they don't even wake the reading thread up.
+ *        An event is delivered if both the mask of the device type and the mask of the device
+ *        accept it. The masks are reset by ginput_quit.
+ *
+ * \remark This function can be called before or after ginput_init, from any thread.
+ *
+ * \param type  the device type
+ * \param mask  the accepted event types, e.g. GE_EVENT_MASK(GE_KEYDOWN) | GE_EVENT_MASK(GE_KEYUP),
+ *              or GE_EVENT_MASK_ALL (default)
+ *
+ * \return 0 in case of success, -1 in case of error.
+ */
+int ginput_set_event_mask(GE_DeviceType type, uint32_t mask);
+
+/*
+ * \brief Select the event types that are delivered for a device.
+ *        The mask applies to the device index, and is kept if the device is unplugged,
+ *        so that it also applies to a device that gets the same index.
+ *
+ * \remark This function can be called before or after ginput_init, from any thread.
+ *
+ * \param type  the device type
+ * \param id    the device index
+ * \param mask  the accepted event types, or GE_EVENT_MASK_ALL (default)
+ *
+ * \return 0 in case of success, -1 in case of error.
+ */
+int ginput_set_device_event_mask(GE_DeviceType type, int id, uint32_t mask);
+
+/*
+ * \brief Get the current state of a joystick, as built from the events delivered so far.
+ *        The state is updated before each event is delivered to the callback (or queued in batch mode),
+ *        and is reset when the device is plugged or unplugged.
+ *
+ * \remark This function can be called from any thread. It never blocks the thread that processes the events,
+ *         but it retries the copy if the state was being updated.
+ *
+ * \param id     the joystick index (in the [0..GE_MAX_DEVICES[ range)
+ * \param state  where to store the state
+ *
+ * \return 0 in case of success, -1 in case of error (invalid index).
+ */
+int ginput_joystick_snapshot(int id, GE_JoystickState * state);
+
+/*
+ * \brief Get the current state of a mouse (see ginput_joystick_snapshot).
+ *
+ * \param id     the mouse index (in the [0..GE_MAX_DEVICES[ range)
+ * \param state  where to store the state
+ *
+ * \return 0 in case of success, -1 in case of error (invalid index).
+ */
+int ginput_mouse_snapshot(int id, GE_MouseState * state);
+
+/*
+ * \brief Get the current state of a keyboard (see ginput_joystick_snapshot).
+ *
+ * \param id     the keyboard index (in the [0..GE_MAX_DEVICES[ range)
+ * \param state  where to store the state
+ *
+ * \return 0 in case of success, -1 in case of error (invalid index).
+ */
+int ginput_keyboard_snapshot(int id, GE_KeyboardState * state);
+
+/*
+ * \brief Get a percentile from a histogram.
+ *
+ * \param histogram   the histogram
+ * \param percentile  the percentile (0 to 100)
+ *
+ * \return the lower bound of the bucket containing the percentile, or 0 if the histogram is empty.
+ */
+uint64_t ginput_histogram_percentile(const GE_Histogram * histogram, double percentile);
+
 /*
  * \brief Get the button name for a given button id.
  *
@@ -614,6 +958,36 @@ GE_MK_Mode ginput_get_mk_mode();
  */
 void ginput_set_mk_mode(GE_MK_Mode value);
 
+/*
+ * \brief Set how relative mouse motion is coalesced by the physical (evdev) mkb source.
+ *        Motion is always reported before any other event of the same mouse.
+ *
+ * \param mode GE_MOTION_FRAME  one motion event per device report (default),
+ *             GE_MOTION_READ   one motion event for all the reports read at once
+ */
+void ginput_set_motion_mode(GE_MotionMode mode);
+
+/*
+ * \brief Set how joystick hats are reported.
+ *        In button mode, hat h is reported as buttons b+4h (up), b+4h+1 (right), b+4h+2 (down)
+ *        and b+4h+3 (left), with b the number of physical buttons.
+ *
+ * \param mode GE_HAT_MODE_BUTTONS  emulated buttons (default),
+ *             GE_HAT_MODE_NATIVE   GE_JOYHATMOTION events
+ */
+void ginput_set_hat_mode(GE_HatMode mode);
+
+/*
+ * \brief Limit the rate of the force feedback updates sent to joysticks.
+ *        Each effect is updated at most once per period, the latest parameters are kept,
+ *        and the deferred updates are flushed by ginput_periodic_task.
+ *        Effects that did not change are never sent again, whatever the rate.
+ *        This is only supported by the GNU/Linux joystick source.
+ *
+ * \param rate  the maximum number of updates per second for each effect, 0 for no limit (default)
+ */
+void ginput_set_haptic_rate(unsigned int rate);
+
 /*
  * \brief Return the haptic capabilities of a joystick.
  *
@@ -651,6 +1025,19 @@ int ginput_queue_pop(GE_Event *events, int numevents);
  */
 int ginput_queue_push(GE_Event *event);
 
+/*
+ * \brief Configure the event queue. The queue is lock-free: ginput_queue_pop can be called
+ *        from a different thread than ginput_queue_push, without any locking.
+ *
+ * \remark This function has to be called before calling ginput_init.
+ *
+ * \param size  the max number of queued events, rounded up to a power of two (0 means 256)
+ * \param mode  GE_QUEUE_SINGLE_PRODUCER or GE_QUEUE_MULTI_PRODUCER
+ *
+ * \return 0 in case of success, -1 in case of error or if the library was already initialized.
+ */
+int ginput_queue_configure(unsigned int size, GE_QueueMode mode);
+
 #ifdef WIN32
 /*
  * \brief Get the USB VID and PID of a joystick.
@@ -688,8 +1075,188 @@ void * ginput_joystick_get_hid(int id);
  * \return 0 in case of success, -1 in case of error.
  */
 int ginput_joystick_set_hid_callbacks(void * dev, void * user, int (* hid_write_cb)(void * user, int status), int (* hid_close_cb)(void * user));
+
+/*
+ * \brief Publish all events into a shared-memory ring, in addition to delivering them to the callback.
+ *        The ring is backed by a memfd, that can be passed to other processes (fork, SCM_RIGHTS,
+ *        or /proc/<pid>/fd/<fd>). Publishing never blocks: consumers that fall behind by more
+ *        than the ring capacity lose the oldest events.
+ *        The file descriptor is closed by ginput_quit.
+ *        This function is Linux-specific.
+ *
+ * \remark This function has to be called before calling ginput_init.
+ *
+ * \param capacity  the number of events in the ring (rounded up to a power of two, 64 minimum)
+ *
+ * \return the file descriptor of the ring, or -1 in case of error.
+ */
+int ginput_shm_create(unsigned int capacity);
+
+/*
+ * \brief Map a shared-memory event ring for reading. Only the events published after this call are read.
+ *        This function does not require ginput_init, and can be called from another process.
+ *        This function is Linux-specific.
+ *
+ * \param fd  the file descriptor returned by ginput_shm_create (or a duplicate)
+ *
+ * \return the ring, or NULL in case of error.
+ */
+GE_ShmRing * ginput_shm_open(int fd);
+
+/*
+ * \brief Read the next events from a shared-memory event ring, without any system call.
+ *        A ring should only be read from one thread; open it once per consumer thread.
+ *
+ * \param ring       the ring returned by ginput_shm_open
+ * \param events     the buffer to store the events
+ * \param numevents  the max number of events to read
+ *
+ * \return the number of read events (0 if no new event was published).
+ */
+int ginput_shm_read(GE_ShmRing * ring, GE_ShmEvent * events, int numevents);
+
+/*
+ * \brief Unmap a shared-memory event ring.
+ *
+ * \param ring  the ring returned by ginput_shm_open
+ */
+void ginput_shm_close(GE_ShmRing * ring);
+
+/*
+ * \brief Read the devices from a dedicated thread, that runs the internal event loop.
+ *        Devices are read as soon as input is available, even if the application thread is busy.
+ *        The events are queued with their timestamps, and delivered by ginput_dispatch.
+ *        Events are lost if the queue is full.
+ *        This function is Linux-specific.
+ *
+ * \remark This function has to be called before calling ginput_init, and the library has to be
+ *         initialized with a NULL poll interface.
+ * \remark Using SCHED_FIFO or mlockall requires the appropriate privileges (CAP_SYS_NICE, CAP_IPC_LOCK
+ *         or rlimits), otherwise ginput_init fails.
+ *
+ * \param config  the reader thread settings, or NULL to disable the reader thread (default)
+ *
+ * \return 0 in case of success, -1 in case of error.
+ */
+int ginput_set_reader_thread(const GE_ReaderConfig * config);
+
+/*
+ * \brief Split the devices across several reader threads, for setups with many devices.
+ *        Each thread waits on its own devices, so that a busy device only delays the devices
+ *        of its thread. New devices go to the thread with the fewest devices.
+ *        Each thread has its own event queue, of the size set by ginput_set_reader_thread.
+ *        The device ids are the same whatever the number of threads.
+ *        This function is Linux-specific.
+ *
+ * \remark This function has to be called before calling ginput_init, and only has an effect
+ *         if the reader thread is enabled (see ginput_set_reader_thread). The threads inherit
+ *         the reader thread settings. If the reader thread is pinned to a CPU, thread i is
+ *         pinned to CPU cpu + i.
+ *
+ * \param shards   the number of reader threads, in the [1, 16] range (default 1)
+ * \param ordered  0 to deliver the events of each thread one thread after the other,
+ *                 1 to merge the events of all threads in timestamp order, at the cost of a sort
+ *
+ * \return 0 in case of success, -1 in case of error.
+ */
+int ginput_set_reader_shards(unsigned int shards, int ordered);
+
+/*
+ * \brief Set how joysticks are read. This function is Linux-specific.
+ *        The evdev backend uses a single file descriptor per joystick, provides precise event timestamps,
+ *        delivers the events frame by frame (SYN_REPORT) in batch mode, and recovers from event queue overflows.
+ *        Axes are scaled from their range to [-32767, 32767], without the calibration of the js interface.
+ *        Axes and buttons are numbered the same way by both backends.
+ *
+ * \remark This function has to be called before calling ginput_init.
+ *
+ * \param backend  GE_JOYSTICK_BACKEND_JS (default) or GE_JOYSTICK_BACKEND_EVDEV
+ *
+ * \return 0 in case of success, -1 in case of error.
+ */
+int ginput_set_joystick_backend(GE_JoystickBackend backend);
+
+/*
+ * \brief Record the raw input of the devices into a capture file, from ginput_init to ginput_quit.
+ *        This function is Linux-specific.
+ *        The capture holds the data read from each device (js_event and input_event records,
+ *        HID reports, and the XInput raw events) with its timestamp, and the device information
+ *        that is needed to translate it, so that it can be replayed with ginput_set_replay.
+ *
+ * \remark This function has to be called before calling ginput_init.
+ *
+ * \param path  the capture file, or NULL to stop recording
+ *
+ * \return 0 in case of success, -1 in case of error.
+ */
+int ginput_set_capture(const char * path);
+
+/*
+ * \brief Replay a capture instead of reading the devices. This function is Linux-specific.
+ *        ginput_init creates the devices of the capture instead of opening the real ones, and the
+ *        recorded input goes through the same translation code, from the event loop.
+ *        The mice and keyboards are only replayed with the mkb source they were recorded with.
+ *        Logitech wheels are not replayed.
+ *
+ * \remark This function has to be called before calling ginput_init.
+ *
+ * \param path  the capture file, or NULL to stop replaying
+ * \param mode  GE_REPLAY_REALTIME or GE_REPLAY_FAST
+ *
+ * \return 0 in case of success, -1 in case of error.
+ */
+int ginput_set_replay(const char * path, GE_ReplayMode mode);
+
+/*
+ * \brief Tell if the whole capture was replayed. This function is Linux-specific.
+ *
+ * \return 1 if the end of the capture was reached, 0 otherwise.
+ */
+int ginput_replay_done();
+
+/*
+ * \brief Get the file descriptor to wait on before calling ginput_dispatch, so that it
+ *        can be watched by another event loop.
+ *        This is the internal event loop (an epoll instance), or an eventfd that is signaled
+ *        when events are queued if the reader thread is used.
+ *        This function is Linux-specific.
+ *
+ * \return the file descriptor, or -1 if the library was not initialized with a NULL poll interface.
+ */
+int ginput_get_fd();
+
+/*
+ * \brief Wait for device input and process it, with the internal event loop.
+ *        Events are delivered to the callback given to ginput_init (or ginput_init_batch)
+ *        before this function returns. ginput_periodic_task still has to be called periodically.
+ *        If the reader thread is used, this function waits for the queued events instead.
+ *        This function is Linux-specific.
+ *
+ * \remark The library has to be initialized with a NULL poll interface.
+ *
+ * \param timeout  the max time to wait in milliseconds, -1 to wait forever, 0 to return immediately
+ *
+ * \return the number of processed file descriptors, or of delivered events if the reader thread
+ *         is used (0 on timeout), or -1 in case of error.
+ */
+int ginput_dispatch(int timeout);
 #endif
 
+/*
+ * \brief Set a callback that reports the end of the native mode switches of Logitech wheels.
+ *        With hotplug, wheels that are not in native mode are switched asynchronously: ginput_init (or hotplug)
+ *        sends the switch command and the wheel is opened once it reappears in native mode,
+ *        which is detected through hotplug or by ginput_periodic_task (checked every second, for up to 5 seconds).
+ *        Without hotplug, ginput_init waits for each wheel to reappear (for up to 5 seconds),
+ *        as the joystick nodes are only scanned once.
+ *        The callback is called from ginput_init, ginput_periodic_task or while processing hotplug events.
+ *        On Windows, wheels have to be switched by the Logitech software, and the callback is never called.
+ *
+ * \param callback  the callback, with the HID device path, the product id in native mode,
+ *                  and a status that is 0 if the wheel is in native mode, or -1 if the switch failed
+ */
+void ginput_set_native_mode_callback(void (* callback)(const char * path, unsigned short product_id, int status));
+
 /*
  * \brief Process all events from non-asynchronous sources.
  *        Poll all hidinput devices.
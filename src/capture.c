@@ -0,0 +1,314 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <gimxcommon/include/gerror.h>
+#include "capture.h"
+
+/*
+ * The records are written by the reading threads. The lock is held while a record is written,
+ * which may flush the stdio buffer to the disk: the other threads sleep instead of spinning.
+ */
+static struct
+{
+  FILE * file;
+  pthread_mutex_t lock;
+  uint8_t used[CAPTURE_MAX_DEVICES / 8]; // the device ids in use
+} capture = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static inline void capture_lock()
+{
+  pthread_mutex_lock(&capture.lock);
+}
+
+static inline void capture_unlock()
+{
+  pthread_mutex_unlock(&capture.lock);
+}
+
+int capture_open(const char * path)
+{
+  capture_close();
+
+  if (path == NULL)
+  {
+    return 0;
+  }
+
+  FILE * file = fopen(path, "wb");
+  if (file == NULL)
+  {
+    PRINT_ERROR_ERRNO("fopen");
+    return -1;
+  }
+
+  struct capture_file_header header = { .magic = CAPTURE_MAGIC, .version = CAPTURE_VERSION };
+  if (fwrite(&header, sizeof(header), 1, file) != 1)
+  {
+    PRINT_ERROR_ERRNO("fwrite");
+    fclose(file);
+    return -1;
+  }
+
+  memset(capture.used, 0x00, sizeof(capture.used));
+  capture.file = file;
+
+  return 0;
+}
+
+int capture_enabled()
+{
+  return capture.file != NULL;
+}
+
+// called with the lock held
+static void capture_write(const void * data, unsigned int size)
+{
+  if (size > 0 && fwrite(data, size, 1, capture.file) != 1)
+  {
+    PRINT_ERROR_ERRNO("fwrite");
+  }
+}
+
+// called with the lock held, the payload follows
+static void capture_write_record(int id, uint8_t type, gtime timestamp, unsigned int size)
+{
+  struct capture_record record = { .timestamp = timestamp, .size = size, .device = id, .type = type };
+
+  capture_write(&record, sizeof(record));
+}
+
+int capture_add_device(const struct capture_device * device)
+{
+  if (capture.file == NULL)
+  {
+    return -1;
+  }
+
+  const char * name = (device->name != NULL) ? device->name : "";
+
+  struct capture_device_header header = {
+      .source = device->source,
+      .flags = device->flags,
+      .vendor = device->vendor,
+      .product = device->product,
+      .interface_number = device->interface_number,
+      .name_size = strlen(name) + 1,
+      .info_size = device->info_size,
+  };
+
+  gtime now = gtime_gettime();
+
+  capture_lock();
+
+  if (capture.file == NULL)
+  {
+    capture_unlock();
+    return -1;
+  }
+
+  int id;
+  for (id = 0; id < CAPTURE_MAX_DEVICES && (capture.used[id / 8] & (1 << (id % 8))); ++id) ;
+
+  if (id == CAPTURE_MAX_DEVICES)
+  {
+    capture_unlock();
+    PRINT_ERROR_OTHER("too many devices in the capture");
+    return -1;
+  }
+
+  capture.used[id / 8] |= 1 << (id % 8);
+
+  capture_write_record(id, CAPTURE_RECORD_DEVICE, now, sizeof(header) + header.name_size + header.info_size);
+  capture_write(&header, sizeof(header));
+  capture_write(name, header.name_size);
+  capture_write(device->info, device->info_size);
+
+  capture_unlock();
+
+  return id;
+}
+
+void capture_remove_device(int id)
+{
+  if (capture.file == NULL || id < 0)
+  {
+    return;
+  }
+
+  gtime now = gtime_gettime();
+
+  capture_lock();
+
+  if (capture.file != NULL)
+  {
+    capture_write_record(id, CAPTURE_RECORD_REMOVED, now, 0);
+    capture.used[id / 8] &= ~(1 << (id % 8));
+  }
+
+  capture_unlock();
+}
+
+void capture_data(int id, gtime timestamp, const void * data, unsigned int size)
+{
+  if (capture.file == NULL || id < 0)
+  {
+    return;
+  }
+
+  capture_lock();
+
+  // the capture may have been closed by another thread
+  if (capture.file != NULL)
+  {
+    capture_write_record(id, CAPTURE_RECORD_DATA, timestamp, size);
+    capture_write(data, size);
+  }
+
+  capture_unlock();
+}
+
+void capture_close()
+{
+  if (capture.file == NULL)
+  {
+    return;
+  }
+
+  capture_lock();
+
+  if (capture.file != NULL && fclose(capture.file) != 0)
+  {
+    PRINT_ERROR_ERRNO("fclose");
+  }
+  capture.file = NULL;
+
+  capture_unlock();
+}
+
+struct capture_reader
+{
+  FILE * file;
+  void * payload;
+  unsigned int size; // the size of the payload buffer
+};
+
+struct capture_reader * capture_reader_open(const char * path)
+{
+  FILE * file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    PRINT_ERROR_ERRNO("fopen");
+    return NULL;
+  }
+
+  struct capture_file_header header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)))
+  {
+    PRINT_ERROR_OTHER("not a capture file");
+    fclose(file);
+    return NULL;
+  }
+
+  if (header.version != CAPTURE_VERSION)
+  {
+    PRINT_ERROR_OTHER("unsupported capture version");
+    fclose(file);
+    return NULL;
+  }
+
+  struct capture_reader * reader = calloc(1, sizeof(*reader));
+  if (reader == NULL)
+  {
+    PRINT_ERROR_ALLOC_FAILED("calloc");
+    fclose(file);
+    return NULL;
+  }
+
+  reader->file = file;
+
+  return reader;
+}
+
+int capture_reader_next(struct capture_reader * reader, struct capture_record * record, const void ** payload)
+{
+  if (fread(record, sizeof(*record), 1, reader->file) != 1)
+  {
+    if (ferror(reader->file))
+    {
+      PRINT_ERROR_ERRNO("fread");
+      return -1;
+    }
+    return 0;
+  }
+
+  if (record->size > reader->size)
+  {
+    void * ptr = realloc(reader->payload, record->size);
+    if (ptr == NULL)
+    {
+      PRINT_ERROR_ALLOC_FAILED("realloc");
+      return -1;
+    }
+    reader->payload = ptr;
+    reader->size = record->size;
+  }
+
+  if (record->size > 0 && fread(reader->payload, record->size, 1, reader->file) != 1)
+  {
+    PRINT_ERROR_OTHER("truncated capture");
+    return -1;
+  }
+
+  *payload = reader->payload;
+
+  return 1;
+}
+
+int capture_parse_device(const void * payload, unsigned int size, struct capture_device * device)
+{
+  struct capture_device_header header;
+  if (size < sizeof(header))
+  {
+    PRINT_ERROR_OTHER("invalid device record");
+    return -1;
+  }
+
+  memcpy(&header, payload, sizeof(header));
+
+  const char * name = (const char *) payload + sizeof(header);
+  if (header.name_size == 0 || (uint64_t) sizeof(header) + header.name_size + header.info_size != size
+      || name[header.name_size - 1] != '\0')
+  {
+    PRINT_ERROR_OTHER("invalid device record");
+    return -1;
+  }
+
+  device->source = header.source;
+  device->flags = header.flags;
+  device->vendor = header.vendor;
+  device->product = header.product;
+  device->interface_number = header.interface_number;
+  device->name = name;
+  device->info = name + header.name_size;
+  device->info_size = header.info_size;
+
+  return 0;
+}
+
+void capture_reader_close(struct capture_reader * reader)
+{
+  if (reader == NULL)
+  {
+    return;
+  }
+
+  fclose(reader->file);
+  free(reader->payload);
+  free(reader);
+}
@@ -0,0 +1,125 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdint.h>
+#include <gimxtime/include/gtime.h>
+
+/*
+ * The capture format: the raw input of the sources, as they read it, so that a session
+ * can be replayed through the same translation code.
+ *
+ * A capture is a file header followed by records. Each record has a header, with the time
+ * the data was read at, and a payload:
+ * - CAPTURE_RECORD_DEVICE: a device was opened, the payload is a struct capture_device_header,
+ *   followed by the device name and the source-specific information
+ * - CAPTURE_RECORD_DATA: raw input of a device: js_event or input_event records, a HID report,
+ *   or a compact XIRawEvent
+ * - CAPTURE_RECORD_REMOVED: a device was closed, there is no payload
+ *
+ * Records use the byte order and the structure layouts of the machine that recorded them:
+ * a capture is meant to be replayed by the same build, on the same architecture.
+ */
+
+#define CAPTURE_MAGIC "GIMXCAP"
+#define CAPTURE_VERSION 1
+
+// the device ids are 16-bit
+#define CAPTURE_MAX_DEVICES 65536
+
+enum capture_record_type
+{
+  CAPTURE_RECORD_DEVICE,
+  CAPTURE_RECORD_DATA,
+  CAPTURE_RECORD_REMOVED,
+};
+
+enum capture_source
+{
+  CAPTURE_SOURCE_JS,       // js_event records
+  CAPTURE_SOURCE_JS_EVDEV, // input_event records, read by the evdev joystick backend
+  CAPTURE_SOURCE_MKB,      // input_event records
+  CAPTURE_SOURCE_HID,      // HID reports
+  CAPTURE_SOURCE_XINPUT,   // compact XIRawEvents
+};
+
+#define CAPTURE_DEVICE_MOUSE    0x01
+#define CAPTURE_DEVICE_KEYBOARD 0x02
+
+struct capture_file_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct capture_record
+{
+  gtime timestamp;
+  uint32_t size; // the size of the payload
+  uint16_t device; // the id of the device in the capture
+  uint8_t type; // enum capture_record_type
+  uint8_t reserved;
+};
+
+struct capture_device_header
+{
+  uint8_t source; // enum capture_source
+  uint8_t flags; // CAPTURE_DEVICE_MOUSE and CAPTURE_DEVICE_KEYBOARD for the mice and keyboards
+  uint16_t vendor; // the USB ids and the interface number of the HID devices
+  uint16_t product;
+  int16_t interface_number;
+  uint32_t name_size; // including the terminating null byte
+  uint32_t info_size;
+};
+
+/*
+ * A device record, once parsed.
+ */
+struct capture_device
+{
+  uint8_t source;
+  uint8_t flags;
+  uint16_t vendor;
+  uint16_t product;
+  int16_t interface_number;
+  const char * name; // the HID device path for HID devices
+  const void * info; // the source-specific information, the same as given to capture_add_device
+  unsigned int info_size;
+};
+
+/*
+ * Recording. The sources call these functions from any thread: the records are serialized.
+ * They do nothing if no capture is being recorded.
+ */
+int capture_open(const char * path);
+int capture_enabled();
+/*
+ * Record a device that was opened, and return its id in the capture, or -1 if no capture
+ * is being recorded or if the device could not be recorded.
+ */
+int capture_add_device(const struct capture_device * device);
+void capture_remove_device(int id);
+// the timestamp is the time the data was read at
+void capture_data(int id, gtime timestamp, const void * data, unsigned int size);
+void capture_close();
+
+/*
+ * Reading.
+ */
+struct capture_reader;
+
+struct capture_reader * capture_reader_open(const char * path);
+/*
+ * Read the next record. The payload stays valid until the next call.
+ * Return 1 if a record was read, 0 at the end of the capture, or -1 in case of error.
+ */
+int capture_reader_next(struct capture_reader * reader, struct capture_record * record, const void ** payload);
+int capture_parse_device(const void * payload, unsigned int size, struct capture_device * device);
+void capture_reader_close(struct capture_reader * reader);
+
+#endif /* CAPTURE_H_ */
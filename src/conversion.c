@@ -5,6 +5,7 @@
 
 #include "conversion.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "events.h"
@@ -262,19 +263,111 @@ static const char* keynames[] =
     "MICMUTE",
 };
 
+#define KEYNAMES_NB (sizeof(keynames)/sizeof(*keynames))
+
 /*
- * This function gives a key code from a char string.
+ * The names are looked up through indexes that are sorted by name, and then by position,
+ * so that duplicate names resolve to the first match of a linear search (e.g. "MENU" gives KEY_MENU).
  */
-uint16_t get_key_from_buffer(const char* buffer)
+struct name_entry
 {
-  unsigned int i;
+  const char* name;
+  int id;
+  unsigned int position; // the position in a linear search
+};
+
+static struct name_entry key_index[KEYNAMES_NB];
+static unsigned int key_index_size = 0;
+
+static struct name_entry mouse_index[2 + GE_MOUSE_BUTTONS_MAX];
+static unsigned int mouse_index_size = 0;
+
+static int compare_entries(const void* a, const void* b)
+{
+  const struct name_entry* ea = a;
+  const struct name_entry* eb = b;
+
+  int ret = strcmp(ea->name, eb->name);
+  if (ret == 0)
+  {
+    ret = (ea->position > eb->position) - (ea->position < eb->position);
+  }
+  return ret;
+}
+
+static void add_entry(struct name_entry* index, unsigned int* size, const char* name, int id)
+{
+  if (name != NULL)
+  {
+    index[*size].name = name;
+    index[*size].id = id;
+    index[*size].position = *size;
+    ++(*size);
+  }
+}
+
+/*
+ * Return the first entry matching the name, or NULL if there is none.
+ */
+static const struct name_entry* find_entry(const struct name_entry* index, unsigned int size, const char* name)
+{
+  unsigned int low = 0;
+  unsigned int high = size;
 
-  for (i = 0; i < sizeof(keynames)/sizeof(*keynames); i++)
+  while (low < high)
   {
-    if (!strcmp(keynames[i], buffer))
+    unsigned int middle = low + (high - low) / 2;
+    if (strcmp(index[middle].name, name) < 0)
     {
-      return i;
+      low = middle + 1;
     }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  if (low < size && !strcmp(index[low].name, name))
+  {
+    return index + low;
+  }
+
+  return NULL;
+}
+
+extern const char* butnames[GE_MOUSE_BUTTONS_MAX];
+
+void conversion_constructor(void) __attribute__((constructor));
+void conversion_constructor(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < KEYNAMES_NB; i++)
+  {
+    add_entry(key_index, &key_index_size, keynames[i], i);
+  }
+  qsort(key_index, key_index_size, sizeof(*key_index), compare_entries);
+
+  // the axis names have precedence over the button names
+  add_entry(mouse_index, &mouse_index_size, MOUSE_AXIS_X, AXIS_X);
+  add_entry(mouse_index, &mouse_index_size, MOUSE_AXIS_Y, AXIS_Y);
+  for (i = 0; i < sizeof(butnames)/sizeof(*butnames); ++i)
+  {
+    add_entry(mouse_index, &mouse_index_size, butnames[i], i);
+  }
+  qsort(mouse_index, mouse_index_size, sizeof(*mouse_index), compare_entries);
+}
+
+/*
+ * This function gives a key code from a char string.
+ */
+uint16_t get_key_from_buffer(const char* buffer)
+{
+  const struct name_entry* entry = find_entry(key_index, key_index_size, buffer);
+
+  if (entry != NULL)
+  {
+    return entry->id;
   }
 
   return 0;
@@ -285,7 +378,7 @@ uint16_t get_key_from_buffer(const char* buffer)
  */
 const char* get_chars_from_key(uint16_t key)
 {
-  if(key > 0 && key < sizeof(keynames)/sizeof(*keynames))
+  if(key > 0 && key < KEYNAMES_NB)
   {
     return keynames[key];
   }
@@ -293,8 +386,6 @@ const char* get_chars_from_key(uint16_t key)
   return keynames[0];
 }
 
-extern const char* butnames[GE_MOUSE_BUTTONS_MAX];
-
 const char* get_chars_from_button(int but)
 {
   if(but >= 0 && (unsigned int) but < sizeof(butnames)/sizeof(*butnames))
@@ -306,28 +397,12 @@ const char* get_chars_from_button(int but)
 
 int get_mouse_event_id_from_buffer(const char* event_id)
 {
-  unsigned int r_event_id = -1;
-  unsigned int i;
+  const struct name_entry* entry = find_entry(mouse_index, mouse_index_size, event_id);
 
-  if (!strncmp(event_id, MOUSE_AXIS_X, sizeof(MOUSE_AXIS_X)))
-  {
-    r_event_id = AXIS_X;
-  }
-  else if (!strncmp(event_id, MOUSE_AXIS_Y, sizeof(MOUSE_AXIS_Y)))
+  if (entry != NULL)
   {
-    r_event_id = AXIS_Y;
-  }
-  else
-  {
-    for(i=0; i<sizeof(butnames)/sizeof(*butnames); ++i)
-    {
-      if(!strcmp(event_id, butnames[i]))
-      {
-        r_event_id = i;
-        break;
-      }
-    }
+    return entry->id;
   }
 
-  return r_event_id;
+  return -1;
 }
@@ -0,0 +1,136 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "dispatch.h"
+#include "events.h"
+#include "timestamp.h"
+#include "state.h"
+#include "mask.h"
+#ifndef WIN32
+#include "shm.h"
+#endif
+
+static int (*event_callback)(GE_Event*) = NULL;
+static int (*batch_callback)(const GE_Event*, unsigned int) = NULL;
+
+/*
+ * The event being processed by the callback, and its timestamp.
+ */
+static __thread struct
+{
+  const GE_Event * event;
+  gtime timestamp;
+} current = { NULL, 0 };
+
+struct delivery
+{
+  const GE_Event * events;
+  const gtime * timestamps;
+  unsigned int count;
+};
+
+/*
+ * The events buffered since the last flush, in batch mode, and the events being delivered.
+ * Sources read at most MAX_EVENTS input events at once, so that a read usually fits in a single batch.
+ */
+static __thread struct
+{
+  GE_Event events[MAX_EVENTS];
+  gtime timestamps[MAX_EVENTS];
+  unsigned int count;
+  struct delivery delivered;
+} batch = { .count = 0 };
+
+void dispatch_init(int (*callback)(GE_Event*), int (*batch_cb)(const GE_Event*, unsigned int))
+{
+  event_callback = callback;
+  batch_callback = batch_cb;
+}
+
+void dispatch_flush()
+{
+  /*
+   * The callback may report events (e.g. by closing a device), that are queued in the batch:
+   * the batch is moved out before it is delivered, and the new events are delivered once it returns.
+   */
+  while (batch.count > 0)
+  {
+    GE_Event events[MAX_EVENTS];
+    gtime timestamps[MAX_EVENTS];
+    unsigned int count = batch.count;
+    memcpy(events, batch.events, count * sizeof(*events));
+    memcpy(timestamps, batch.timestamps, count * sizeof(*timestamps));
+    batch.count = 0;
+
+    // a flush may be nested in the callback of another one
+    struct delivery previous = batch.delivered;
+    batch.delivered = (struct delivery) { events, timestamps, count };
+
+    batch_callback(events, count);
+
+    batch.delivered = previous;
+  }
+}
+
+int dispatch_event(GE_Event* event)
+{
+  // the sources drop most filtered events before translating them, this catches the others
+  if (!mask_accepts_event(event))
+  {
+    return 0;
+  }
+
+  gtime timestamp = timestamp_get();
+
+  state_update(event, timestamp);
+
+#ifndef WIN32
+  if (shm_enabled())
+  {
+    shm_publish(event, timestamp);
+  }
+#endif
+
+  if (batch_callback != NULL)
+  {
+    if (batch.count == MAX_EVENTS)
+    {
+      dispatch_flush();
+    }
+    batch.events[batch.count] = *event;
+    batch.timestamps[batch.count] = timestamp;
+    ++batch.count;
+    return 0;
+  }
+
+  current.event = event;
+  current.timestamp = timestamp;
+
+  int ret = event_callback(event);
+
+  current.event = NULL;
+
+  return ret;
+}
+
+gtime dispatch_get_timestamp(const GE_Event * event)
+{
+  if (event == NULL)
+  {
+    return 0;
+  }
+  if (event == current.event)
+  {
+    return current.timestamp;
+  }
+  if (event >= batch.delivered.events && event < batch.delivered.events + batch.delivered.count)
+  {
+    return batch.delivered.timestamps[event - batch.delivered.events];
+  }
+  return 0;
+}
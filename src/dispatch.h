@@ -0,0 +1,27 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef DISPATCH_H_
+#define DISPATCH_H_
+
+#include <ginput.h>
+
+/*
+ * Delivery of the events reported by the sources to the application.
+ *
+ * Sources report events through dispatch_event (this is the callback given to their init function),
+ * and call dispatch_flush once they are done processing a read. In batch mode the events are
+ * buffered until the flush, and delivered with a single call to the batch callback.
+ */
+void dispatch_init(int (*callback)(GE_Event*), int (*batch_callback)(const GE_Event*, unsigned int));
+int dispatch_event(GE_Event* event);
+void dispatch_flush();
+
+/*
+ * Get the timestamp of an event that is being processed by the application callback.
+ */
+gtime dispatch_get_timestamp(const GE_Event * event);
+
+#endif /* DISPATCH_H_ */
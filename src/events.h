@@ -18,12 +18,26 @@
 
 #define MAX_EVENTS 256
 
+struct capture_device;
+
 struct mkb_source {
     int (* init)(const GPOLL_INTERFACE * poll_interface, int (*callback)(GE_Event*));
     int (* get_src)();
     int (* grab)(int mode);
     const char * (* get_mouse_name)(int id);
     const char * (* get_keyboard_name)(int id);
+    int (* get_mouse_stats)(int id, GE_Stats * stats); // optional
+    int (* get_keyboard_stats)(int id, GE_Stats * stats); // optional
+    int (* get_mouse_overflows)(int id, uint64_t * overflows); // optional
+    int (* get_keyboard_overflows)(int id, uint64_t * overflows); // optional
+    void (* set_motion_mode)(GE_MotionMode mode); // optional
+    void (* set_hotplug)(int enable); // optional
+    void (* update_event_masks)(); // optional, the event masks changed
+    int (* open)(const char * node); // optional, open a device node that appeared after init
+    int (* init_capture)(int (*callback)(GE_Event*)); // optional, init without opening any device, to replay a capture
+    int (* open_capture)(int id, const struct capture_device * device); // optional, create a replayed device
+    void (* process_capture)(int id, const void * data, unsigned int size); // optional, process replayed data
+    void (* close_capture)(int id); // optional, close a replayed device
     int (* sync_process)();
     void (* quit)();
 };
@@ -37,8 +51,21 @@ struct js_source {
     int (* get_haptic)(int joystick);
     int (* set_haptic)(const GE_Event * haptic);
     void * (* get_hid)(int joystick);
+    int (* get_stats)(int joystick, GE_Stats * stats); // optional
+    int (* get_overflows)(int joystick, uint64_t * overflows); // optional
 	int (* get_usb_ids)(int joystick, unsigned short * vendor, unsigned short * product);
     int (* close)(int joystick);
+    int (* remove)(int joystick); // optional, close a joystick that was unplugged
+    void (* set_hat_mode)(GE_HatMode mode); // optional
+    void (* set_haptic_rate)(unsigned int rate); // optional
+    int (* set_backend)(GE_JoystickBackend backend); // optional
+    void (* set_hotplug)(int enable); // optional
+    void (* update_event_masks)(); // optional, the event masks changed
+    int (* open)(const char * node); // optional, open a device node that appeared after init
+    int (* init_capture)(int (*callback)(GE_Event*)); // optional, init without opening any device, to replay a capture
+    int (* open_capture)(int id, const struct capture_device * device); // optional, create a replayed device
+    void (* process_capture)(int id, const void * data, unsigned int size); // optional, process replayed data
+    void (* close_capture)(int id); // optional, close a replayed device
     int (* sync_process)();
     void (* quit)();
 };
@@ -50,6 +77,7 @@ void ev_quit();
 
 int ev_joystick_register(const char* name, unsigned int effects, int (*haptic_cb)(const GE_Event * event));
 void ev_joystick_close(int);
+void ev_joystick_remove(int);
 const char* ev_joystick_name(int);
 const char* ev_mouse_name(int);
 const char* ev_keyboard_name(int);
@@ -59,10 +87,23 @@ int ev_joystick_set_haptic(const GE_Event * event);
 
 #ifndef WIN32
 void * ev_joystick_get_hid(int joystick);
+int ev_set_joystick_backend(GE_JoystickBackend backend);
+struct js_source * ev_get_js_source();
+struct mkb_source * ev_get_mkb_source(int src);
 #else
 int ev_joystick_get_usb_ids(int joystick, unsigned short * vendor, unsigned short * product);
 #endif
 
+void ev_set_motion_mode(GE_MotionMode mode);
+void ev_set_hat_mode(GE_HatMode mode);
+void ev_set_haptic_rate(unsigned int rate);
+
+int ev_get_stats(GE_DeviceType type, int id, GE_Stats * stats);
+int ev_get_overflows(GE_DeviceType type, int id, uint64_t * overflows);
+void ev_update_event_masks();
+
+int ev_hotplug_init(const GPOLL_INTERFACE * poll_interface);
+
 int ev_grab_input(int);
 void ev_pump_events();
 void ev_sync_process();
@@ -10,9 +10,18 @@
 #include <stdio.h>
 
 #include "conversion.h"
+#include "names.h"
+#include "state.h"
+#include "mask.h"
 #include "events.h"
 #include "queue.h"
+#include "dispatch.h"
 #ifndef WIN32
+#include "shm.h"
+#include "loop.h"
+#include "reader.h"
+#include "capture.h"
+#include "replay.h"
 #include <poll.h>
 #else
 #include <windows.h>
@@ -34,76 +43,118 @@
 
 GLOG_INST(GLOG_NAME)
 
+/*
+ * The device names are interned in per-type tables, that also give the device index
+ * for a name and a virtual index.
+ */
 static struct
 {
-  char* name;
+  const char* name;
   int virtualIndex;
   unsigned char isUsed;
 } joysticks[GE_MAX_DEVICES] = {};
 
+static struct names joystick_names = {};
+
 static struct
 {
-  char* name;
+  const char* name;
   int virtualIndex;
 } mice[GE_MAX_DEVICES] = {};
 
+static struct names mouse_names = {};
+
 static struct
 {
-  char* name;
+  const char* name;
   int virtualIndex;
 } keyboards[GE_MAX_DEVICES] = {};
 
+static struct names keyboard_names = {};
+
 static int grab = GE_GRAB_OFF;
 
 static GE_MK_Mode mk_mode = GE_MK_MODE_MULTIPLE_INPUTS;
 
 static int initialized = 0;
 
+static int queue_configured = 0;
+
+static int hotplug = 0;
+
+/*
+ * Sources can be called from the application thread while the reader thread runs their callbacks.
+ */
+#ifndef WIN32
+#define LOCK_SOURCES() loop_lock()
+#define UNLOCK_SOURCES() loop_unlock()
+#else
+#define LOCK_SOURCES()
+#define UNLOCK_SOURCES()
+#endif
+
+static const char * get_joystick_name(const char * name)
+{
+#ifdef __linux__
+  if (!strncmp(name, BT_SIXAXIS_NAME, sizeof(BT_SIXAXIS_NAME) - 1))
+  {
+    // Rename QtSixA devices.
+    name = SIXAXIS_NAME;
+  }
+  else if (!strncmp(name, DUALSHOCK4_V2_NAME, sizeof(DUALSHOCK4_V2_NAME)))
+  {
+    // Rename Dualshock 4 v2.
+    name = DUALSHOCK4_NAME;
+  }
+  else if (!strncmp(name, XBOX_CONTROLLER_V2_NAME, sizeof(XBOX_CONTROLLER_V2_NAME)))
+  {
+    name = XBOX_CONTROLLER_NAME;
+  }
+  else if (!strncmp(name, XBOX_CONTROLLER_V3_NAME, sizeof(XBOX_CONTROLLER_V3_NAME)))
+  {
+    name = XBOX_CONTROLLER_NAME;
+  }
+#endif
+  return name;
+}
+
+/*
+ * Set the name of a device.
+ * A device that is plugged again keeps its virtual index,
+ * else it gets the lowest free virtual index for its name.
+ */
+#define SET_NAME(DEVICES, NAMES, INDEX, NAME) \
+  do \
+  { \
+    if (DEVICES[INDEX].name != NULL) \
+    { \
+      if (!strcmp(DEVICES[INDEX].name, NAME)) \
+      { \
+        break; \
+      } \
+      names_remove(&NAMES, DEVICES[INDEX].name, DEVICES[INDEX].virtualIndex); \
+    } \
+    DEVICES[INDEX].virtualIndex = 0; \
+    DEVICES[INDEX].name = names_add(&NAMES, NAME, INDEX, &DEVICES[INDEX].virtualIndex); \
+  } while (0)
+
+#define CLEAR_NAME(DEVICES, NAMES, INDEX) \
+  do \
+  { \
+    if (DEVICES[INDEX].name != NULL) \
+    { \
+      names_remove(&NAMES, DEVICES[INDEX].name, DEVICES[INDEX].virtualIndex); \
+      DEVICES[INDEX].name = NULL; \
+    } \
+  } while (0)
+
 static void get_joysticks()
 {
   const char* name;
-  int j;
   int i = 0;
   while (i < GE_MAX_DEVICES && (name = ev_joystick_name(i)))
   {
-#ifdef __linux__
-    if (!strncmp(name, BT_SIXAXIS_NAME, sizeof(BT_SIXAXIS_NAME) - 1))
-    {
-      // Rename QtSixA devices.
-      name = SIXAXIS_NAME;
-    }
-    else if (!strncmp(name, DUALSHOCK4_V2_NAME, sizeof(DUALSHOCK4_V2_NAME)))
-    {
-      // Rename Dualshock 4 v2.
-      name = DUALSHOCK4_NAME;
-    }
-    else if (!strncmp(name, XBOX_CONTROLLER_V2_NAME, sizeof(XBOX_CONTROLLER_V2_NAME)))
-    {
-      name = XBOX_CONTROLLER_NAME;
-    }
-    else if (!strncmp(name, XBOX_CONTROLLER_V3_NAME, sizeof(XBOX_CONTROLLER_V3_NAME)))
-    {
-      name = XBOX_CONTROLLER_NAME;
-    }
-#endif
-
-    joysticks[i].name = strdup(name);
-
-    // Go backward and look for a joystick with the same name.
-    for (j = i - 1; j >= 0; --j)
-    {
-      if (!strcmp(joysticks[i].name, joysticks[j].name))
-      {
-        // Found => compute the virtual index.
-        joysticks[i].virtualIndex = joysticks[j].virtualIndex + 1;
-        break;
-      }
-    }
-    if (j < 0)
-    {
-      // Not found => the virtual index is 0.
-      joysticks[i].virtualIndex = 0;
-    }
+    SET_NAME(joysticks, joystick_names, i, get_joystick_name(name));
     i++;
   }
 }
@@ -111,61 +162,109 @@ static void get_joysticks()
 static void get_mkbs()
 {
   const char* name;
-  int j;
   int i = 0;
   while (i < GE_MAX_DEVICES && (name = ev_mouse_name(i)))
   {
-    mice[i].name = strdup(name);
-
-    // Go backward and look for a mouse with the same name.
-    for (j = i - 1; j >= 0; --j)
-    {
-      if (!strcmp(mice[i].name, mice[j].name))
-      {
-        // Found => compute the virtual index.
-        mice[i].virtualIndex = mice[j].virtualIndex + 1;
-        break;
-      }
-    }
-    if (j < 0)
-    {
-      // Not found => the virtual index is 0.
-      mice[i].virtualIndex = 0;
-    }
+    SET_NAME(mice, mouse_names, i, name);
     i++;
   }
   i = 0;
   while (i < GE_MAX_DEVICES && (name = ev_keyboard_name(i)))
   {
-    keyboards[i].name = strdup(name);
+    SET_NAME(keyboards, keyboard_names, i, name);
+    i++;
+  }
+}
 
-    // Go backward and look for a keyboard with the same name.
-    for (j = i - 1; j >= 0; --j)
-    {
-      if (!strcmp(keyboards[i].name, keyboards[j].name))
+/*
+ * Keep track of the devices that are plugged after initialization.
+ * Removed devices keep their name, so that they get the same virtual index if they are plugged again.
+ * With the reader thread, this runs on the application thread while the reader threads open and
+ * close devices: the device name is copied with the sources locked.
+ */
+static int process_hotplug_event(GE_Event* event)
+{
+  const char * name;
+  LOCK_SOURCES();
+  switch (event->type)
+  {
+    case GE_JOYDEVICEADDED:
+      if ((name = ev_joystick_name(event->which)) != NULL)
+      {
+        SET_NAME(joysticks, joystick_names, event->which, get_joystick_name(name));
+      }
+      break;
+    case GE_MOUSEDEVICEADDED:
+      if ((name = ev_mouse_name(event->which)) != NULL)
+      {
+        SET_NAME(mice, mouse_names, event->which, name);
+      }
+      break;
+    case GE_KEYBOARDDEVICEADDED:
+      if ((name = ev_keyboard_name(event->which)) != NULL)
       {
-        // Found => compute the virtual index.
-        keyboards[i].virtualIndex = keyboards[j].virtualIndex + 1;
-        break;
+        SET_NAME(keyboards, keyboard_names, event->which, name);
       }
+      break;
+  }
+  UNLOCK_SOURCES();
+
+  return dispatch_event(event);
+}
+
+static int init(const GPOLL_INTERFACE * poll_interface, unsigned char mkb_src)
+{
+  int (*callback)(GE_Event*) = hotplug ? process_hotplug_event : dispatch_event;
+
+  // the sources that read until their fds are drained
+  const GPOLL_INTERFACE * ev_poll_interface = poll_interface;
+  // the hotplug source, that opens devices of any shard
+  const GPOLL_INTERFACE * hotplug_poll_interface = poll_interface;
+  // the HID devices of a capture are created by the joystick source instead
+  int replaying = 0;
+
+#ifndef WIN32
+  if (reader_enabled())
+  {
+    if (poll_interface != NULL)
+    {
+      PRINT_ERROR_OTHER("the reader thread requires the internal event loop (NULL poll_interface)");
+      return -1;
     }
-    if (j < 0)
+    // the events are delivered by ginput_dispatch, from the application thread
+    callback = reader_push;
+  }
+
+  if (poll_interface == NULL)
+  {
+    if (loop_init(reader_enabled() ? reader_get_shards() : 1) < 0)
     {
-      // Not found => the virtual index is 0.
-      keyboards[i].virtualIndex = 0;
+      return -1;
     }
-    i++;
+    poll_interface = &loop_interface;
+    // the X source reads its fd through Xlib, that does not tell when the fd is drained
+    ev_poll_interface = (mkb_src == GE_MKB_SOURCE_WINDOW_SYSTEM) ? &loop_interface : &loop_interface_edge;
+    hotplug_poll_interface = &loop_interface_exclusive;
   }
-}
 
-int ginput_init(const GPOLL_INTERFACE * poll_interface, unsigned char mkb_src, int(*callback)(GE_Event*))
-{
-  if (hidinput_init(poll_interface, callback) < 0)
+  replaying = replay_enabled();
+#else
+  if (poll_interface == NULL)
+  {
+    PRINT_ERROR_OTHER("poll_interface is NULL");
+    return -1;
+  }
+#endif
+
+  // without hotplug, the wheels have to be in native mode before the joystick nodes are scanned
+  logitechwheel_set_hotplug(hotplug);
+
+  if (!replaying && hidinput_init(poll_interface, callback) < 0)
   {
       return -1;
   }
 
-  if (ev_init(poll_interface, mkb_src, callback) < 0)
+  if (ev_init(ev_poll_interface, mkb_src, callback) < 0)
   {
     return -1;
   }
@@ -177,73 +276,136 @@ int ginput_init(const GPOLL_INTERFACE * poll_interface, unsigned char mkb_src, i
     get_mkbs();
   }
 
-  queue_init();
+  if (!queue_configured && queue_init(MAX_EVENTS, 0) < 0)
+  {
+    return -1;
+  }
+
+  if (hotplug && ev_hotplug_init(hotplug_poll_interface) < 0)
+  {
+    return -1;
+  }
+
+#ifndef WIN32
+  if (reader_enabled() && reader_start() < 0)
+  {
+    return -1;
+  }
+#endif
 
   initialized = 1;
 
   return 0;
 }
 
+int ginput_init(const GPOLL_INTERFACE * poll_interface, unsigned char mkb_src, int(*callback)(GE_Event*))
+{
+  if (callback == NULL)
+  {
+    PRINT_ERROR_OTHER("callback is NULL");
+    return -1;
+  }
+
+  dispatch_init(callback, NULL);
+
+  return init(poll_interface, mkb_src);
+}
+
+int ginput_init_batch(const GPOLL_INTERFACE * poll_interface, unsigned char mkb_src, int(*callback)(const GE_Event*, unsigned int))
+{
+  if (callback == NULL)
+  {
+    PRINT_ERROR_OTHER("callback is NULL");
+    return -1;
+  }
+
+  dispatch_init(NULL, callback);
+
+  return init(poll_interface, mkb_src);
+}
+
 void ginput_release_unused()
 {
+  LOCK_SOURCES();
   int i;
-  for (i = 0; i < GE_MAX_DEVICES && joysticks[i].name; ++i)
+  for (i = 0; i < GE_MAX_DEVICES; ++i)
   {
-    if (!joysticks[i].isUsed)
+    if (joysticks[i].name && !joysticks[i].isUsed)
     {
-      free(joysticks[i].name);
-      joysticks[i].name = NULL;
+      CLEAR_NAME(joysticks, joystick_names, i);
       ev_joystick_close(i);
     }
   }
+  UNLOCK_SOURCES();
 }
 
 int ginput_grab_toggle()
 {
+  LOCK_SOURCES();
   grab = ev_grab_input(grab ? GE_GRAB_OFF : GE_GRAB_ON);
+  UNLOCK_SOURCES();
 
   return grab;
 }
 
 void ginput_grab()
 {
+  LOCK_SOURCES();
   ev_grab_input(GE_GRAB_ON);
+  UNLOCK_SOURCES();
   grab = 1;
 }
 
 void ginput_free_mk_names()
 {
   int i;
-  for (i = 0; i < GE_MAX_DEVICES && mice[i].name; ++i)
+  for (i = 0; i < GE_MAX_DEVICES; ++i)
   {
-    free(mice[i].name);
     mice[i].name = NULL;
   }
-  for (i = 0; i < GE_MAX_DEVICES && keyboards[i].name; ++i)
+  names_clear(&mouse_names);
+  for (i = 0; i < GE_MAX_DEVICES; ++i)
   {
-    free(keyboards[i].name);
     keyboards[i].name = NULL;
   }
+  names_clear(&keyboard_names);
 }
 
 void ginput_quit()
 {
   int i;
 
+#ifndef WIN32
+  reader_stop();
+  replay_quit();
+#endif
+
   for (i = 0; i < GE_MAX_DEVICES; ++i)
   {
     if (joysticks[i].name)
     {
-      free(joysticks[i].name);
       joysticks[i].name = NULL;
       ev_joystick_close(i);
     }
   }
+  names_clear(&joystick_names);
   ginput_free_mk_names();
   ev_quit();
 
   hidinput_quit();
 
+#ifndef WIN32
+  capture_close();
+  shm_quit();
+  loop_quit();
+#endif
+
+  queue_quit();
+  queue_configured = 0;
+
+  state_reset();
+  mask_reset();
+
   initialized = 0;
 }
 
@@ -302,6 +464,21 @@ int ginput_register_joystick(const char* name, unsigned int effects, int (*hapti
   return ev_joystick_register(name, effects, haptic_cb);
 }
 
+int ginput_joystick_id(const char * name, int virtual_id)
+{
+  return names_get_index(&joystick_names, name, virtual_id);
+}
+
+int ginput_mouse_id(const char * name, int virtual_id)
+{
+  return names_get_index(&mouse_names, name, virtual_id);
+}
+
+int ginput_keyboard_id(const char * name, int virtual_id)
+{
+  return names_get_index(&keyboard_names, name, virtual_id);
+}
+
 int ginput_mouse_virtual_id(int id)
 {
   if (id >= 0 && id < GE_MAX_DEVICES)
@@ -330,6 +507,129 @@ void ginput_set_mk_mode(GE_MK_Mode value)
   mk_mode = value;
 }
 
+int ginput_set_hotplug(int enable)
+{
+  if(initialized)
+  {
+    PRINT_ERROR_OTHER("this function can only be called before ginput_init");
+    return -1;
+  }
+
+  hotplug = enable;
+
+  return 0;
+}
+
+void ginput_set_motion_mode(GE_MotionMode mode)
+{
+  ev_set_motion_mode(mode);
+}
+
+void ginput_set_hat_mode(GE_HatMode mode)
+{
+  LOCK_SOURCES();
+  ev_set_hat_mode(mode);
+  UNLOCK_SOURCES();
+}
+
+void ginput_set_haptic_rate(unsigned int rate)
+{
+  LOCK_SOURCES();
+  ev_set_haptic_rate(rate);
+  UNLOCK_SOURCES();
+}
+
+#ifndef WIN32
+int ginput_shm_create(unsigned int capacity)
+{
+  if(initialized)
+  {
+    PRINT_ERROR_OTHER("this function can only be called before ginput_init");
+    return -1;
+  }
+
+  return shm_init(capacity);
+}
+
+int ginput_set_reader_thread(const GE_ReaderConfig * config)
+{
+  if(initialized)
+  {
+    PRINT_ERROR_OTHER("this function can only be called before ginput_init");
+    return -1;
+  }
+
+  return reader_configure(config);
+}
+
+int ginput_set_reader_shards(unsigned int shards, int ordered)
+{
+  if(initialized)
+  {
+    PRINT_ERROR_OTHER("this function can only be called before ginput_init");
+    return -1;
+  }
+
+  return reader_set_shards(shards, ordered);
+}
+
+int ginput_set_joystick_backend(GE_JoystickBackend backend)
+{
+  if(initialized)
+  {
+    PRINT_ERROR_OTHER("this function can only be called before ginput_init");
+    return -1;
+  }
+
+  return ev_set_joystick_backend(backend);
+}
+
+int ginput_set_capture(const char * path)
+{
+  if(initialized)
+  {
+    PRINT_ERROR_OTHER("this function can only be called before ginput_init");
+    return -1;
+  }
+
+  return capture_open(path);
+}
+
+int ginput_set_replay(const char * path, GE_ReplayMode mode)
+{
+  if(initialized)
+  {
+    PRINT_ERROR_OTHER("this function can only be called before ginput_init");
+    return -1;
+  }
+
+  return replay_configure(path, mode);
+}
+
+int ginput_replay_done()
+{
+  return replay_done();
+}
+
+int ginput_get_fd()
+{
+  if (reader_enabled())
+  {
+    return reader_get_fd();
+  }
+  return loop_get_fd();
+}
+
+int ginput_dispatch(int timeout)
+{
+  if (reader_enabled())
+  {
+    return reader_dispatch(timeout, hotplug ? process_hotplug_event : dispatch_event);
+  }
+  return loop_dispatch(timeout);
+}
+#endif
+
 int ginput_get_device_id(GE_Event* e)
 {
   /*
@@ -365,14 +665,38 @@ int ginput_queue_push(GE_Event *event)
   return queue_push_event(event);
 }
 
+int ginput_queue_configure(unsigned int size, GE_QueueMode mode)
+{
+  if(initialized)
+  {
+    PRINT_ERROR_OTHER("this function can only be called before ginput_init");
+    return -1;
+  }
+
+  if (queue_init(size, mode == GE_QUEUE_MULTI_PRODUCER) < 0)
+  {
+    return -1;
+  }
+
+  queue_configured = 1;
+
+  return 0;
+}
+
 int ginput_joystick_get_haptic(int id)
 {
-  return ev_joystick_get_haptic(id);
+  LOCK_SOURCES();
+  int ret = ev_joystick_get_haptic(id);
+  UNLOCK_SOURCES();
+  return ret;
 }
 
 int ginput_joystick_set_haptic(const GE_Event * event)
 {
-  return ev_joystick_set_haptic(event);
+  LOCK_SOURCES();
+  int ret = ev_joystick_set_haptic(event);
+  UNLOCK_SOURCES();
+  return ret;
 }
 
 #ifndef WIN32
@@ -392,10 +716,24 @@ int ginput_joystick_get_usb_ids(int id, unsigned short * vendor, unsigned short
 }
 #endif
 
+void ginput_set_native_mode_callback(void (* callback)(const char * path, unsigned short product_id, int status))
+{
+  logitechwheel_set_native_mode_callback(callback);
+}
+
 void ginput_periodic_task()
 {
+  LOCK_SOURCES();
   ev_sync_process();
   hidinput_poll();
+  UNLOCK_SOURCES();
+#ifndef WIN32
+  if (reader_enabled())
+  {
+    reader_signal();
+  }
+#endif
+  dispatch_flush();
 }
 
 int ginput_queue_pop(GE_Event *events, int numevents)
@@ -403,6 +741,108 @@ int ginput_queue_pop(GE_Event *events, int numevents)
   return queue_pop_events(events, numevents);
 }
 
+gtime ginput_event_timestamp(const GE_Event * event)
+{
+  return dispatch_get_timestamp(event);
+}
+
+gtime ginput_event_latency(const GE_Event * event)
+{
+  gtime timestamp = ginput_event_timestamp(event);
+  if (timestamp == 0)
+  {
+    return 0;
+  }
+  gtime now = gtime_gettime();
+  return now > timestamp ? now - timestamp : 0;
+}
+
+int ginput_get_stats(GE_DeviceType type, int id, GE_Stats * stats)
+{
+  if (stats == NULL)
+  {
+    PRINT_ERROR_OTHER("stats is NULL");
+    return -1;
+  }
+
+  if (ev_get_stats(type, id, stats) == 0)
+  {
+    return 0;
+  }
+
+  if (type == GE_DEVICE_JOYSTICK)
+  {
+    // joysticks registered by HID drivers, that are closed by the loop callbacks
+    LOCK_SOURCES();
+    int ret = hidinput_get_stats(id, stats);
+    UNLOCK_SOURCES();
+    return ret;
+  }
+
+  return -1;
+}
+
+int ginput_get_overflows(GE_DeviceType type, int id, uint64_t * overflows)
+{
+  if (overflows == NULL)
+  {
+    PRINT_ERROR_OTHER("overflows is NULL");
+    return -1;
+  }
+
+  return ev_get_overflows(type, id, overflows);
+}
+
+static int set_event_mask(GE_DeviceType type, int id, uint32_t mask)
+{
+  if (type < GE_DEVICE_JOYSTICK || type > GE_DEVICE_KEYBOARD)
+  {
+    PRINT_ERROR_OTHER("invalid device type");
+    return -1;
+  }
+
+  LOCK_SOURCES();
+  mask_set(type, id, mask);
+  if (initialized)
+  {
+    ev_update_event_masks();
+  }
+  UNLOCK_SOURCES();
+
+  return 0;
+}
+
+int ginput_set_event_mask(GE_DeviceType type, uint32_t mask)
+{
+  return set_event_mask(type, -1, mask);
+}
+
+int ginput_set_device_event_mask(GE_DeviceType type, int id, uint32_t mask)
+{
+  if (id < 0 || id >= GE_MAX_DEVICES)
+  {
+    PRINT_ERROR_OTHER("invalid device index");
+    return -1;
+  }
+
+  return set_event_mask(type, id, mask);
+}
+
+int ginput_joystick_snapshot(int id, GE_JoystickState * state)
+{
+  return state_get(GE_DEVICE_JOYSTICK, id, state);
+}
+
+int ginput_mouse_snapshot(int id, GE_MouseState * state)
+{
+  return state_get(GE_DEVICE_MOUSE, id, state);
+}
+
+int ginput_keyboard_snapshot(int id, GE_KeyboardState * state)
+{
+  return state_get(GE_DEVICE_KEYBOARD, id, state);
+}
+
 const char* ginput_mouse_button_name(int button)
 {
   return get_chars_from_button(button);
@@ -4,6 +4,11 @@
  */
 
 #include "hidinput.h"
+#include "../timestamp.h"
+#include "../dispatch.h"
+#include "../stats.h"
+#include "../mask.h"
+#include "../capture.h"
 #include <gimxpoll/include/gpoll.h>
 #include <gimxcommon/include/gerror.h>
 #include <gimxcommon/include/glist.h>
@@ -20,7 +25,11 @@ struct hidinput_device {
     s_hidinput_driver * driver;
     struct hidinput_device_internal * device;
     struct ghid_device * hid;
+    char * path;
     int read_pending;
+    int capture; // the id of the device in the capture that is recorded, or -1
+    int replay; // the id of the device in the capture that is replayed, or -1 if it is a real device
+    STATS_FIELD
     struct {
         void * user;
         int (* write)(void * user, int transfered);
@@ -35,6 +44,10 @@ static int close_device(struct hidinput_device * device) {
         device->driver->close(device->device);
     }
 
+    capture_remove_device(device->capture);
+
+    free(device->path);
+
     GLIST_REMOVE(hidinput_devices, device);
 
     free(device);
@@ -44,23 +57,48 @@ static int close_device(struct hidinput_device * device) {
 
 static GLIST_INST(struct hidinput_device, hidinput_devices);
 
-static int read_callback(void * user, const void * buf, int status) {
+#define JOYSTICK_INPUT_TYPES (GE_EVENT_MASK(GE_JOYAXISMOTION) | GE_EVENT_MASK(GE_JOYHATMOTION) \
+    | GE_EVENT_MASK(GE_JOYBUTTONDOWN) | GE_EVENT_MASK(GE_JOYBUTTONUP))
 
-    struct hidinput_device * device = (struct hidinput_device *) user;
+static int process_report(struct hidinput_device * device, const void * buf, int status) {
 
     int ret = 0;
 
-    device->read_pending = 0;
+    if (status > 0 && device->capture >= 0) {
+        capture_data(device->capture, gtime_gettime(), buf, status);
+    }
+
+    if (status > 0 && device->driver->get_joystick != NULL) {
+        // don't translate the reports of a joystick for which all input events are filtered
+        int joystick = device->driver->get_joystick(device->device);
+        if (joystick >= 0 && !(mask_get(GE_DEVICE_JOYSTICK, joystick) & JOYSTICK_INPUT_TYPES)) {
+            return 0;
+        }
+    }
 
     if (status > 0) {
+        gtime now = gtime_gettime();
+        timestamp_set(now);
         if (device->driver->process(device->device, buf, status) < 0) {
           ret = -1;
         }
+        dispatch_flush();
+        STATS_READ(device, 1);
+        STATS_READ_TO_CALLBACK(device, now);
     }
 
     return ret;
 }
 
+static int read_callback(void * user, const void * buf, int status) {
+
+    struct hidinput_device * device = (struct hidinput_device *) user;
+
+    device->read_pending = 0;
+
+    return process_report(device, buf, status);
+}
+
 static int write_callback(void * user, int status) {
 
     struct hidinput_device * device = (struct hidinput_device *) user;
@@ -103,31 +141,30 @@ int hidinput_register(s_hidinput_driver * driver) {
     return 0;
 }
 
-int hidinput_init(const GPOLL_INTERFACE * poll_interface, int(*callback)(GE_Event*)) {
+static GPOLL_REGISTER_FD fp_register = NULL;
+static GPOLL_REMOVE_FD fp_remove = NULL;
 
-    if (callback == NULL) {
-      PRINT_ERROR_OTHER("callback is NULL");
-      return -1;
-    }
+static int is_opened(const char * path) {
 
-    if (poll_interface->fp_register == NULL) {
-        PRINT_ERROR_OTHER("fp_register_fd is NULL");
-        return -1;
+    struct hidinput_device * device;
+    for (device = GLIST_BEGIN(hidinput_devices); device != GLIST_END(hidinput_devices); device = device->next) {
+        if (device->path != NULL && path != NULL && !strcmp(device->path, path)) {
+            return 1;
+        }
     }
+    return 0;
+}
 
-    if (poll_interface->fp_remove == NULL) {
-        PRINT_ERROR_OTHER("fp_remove is NULL");
-        return -1;
-    }
+static void open_devices() {
 
     unsigned int driver;
-    for (driver = 0; driver < nb_drivers; ++driver) {
-        drivers[driver]->init(callback);
-    }
 
     struct ghid_device_info * hid_devs = ghid_enumerate(0x0000, 0x0000);
     struct ghid_device_info * current;
     for (current = hid_devs; current != NULL; current = current->next) {
+        if (is_opened(current->path)) {
+            continue;
+        }
         for (driver = 0; driver < nb_drivers; ++driver) {
             unsigned int id;
             for (id = 0; drivers[driver]->ids[id].vendor_id != 0; ++id) {
@@ -139,19 +176,26 @@ int hidinput_init(const GPOLL_INTERFACE * poll_interface, int(*callback)(GE_Even
                     if (device_internal != NULL) {
                         struct hidinput_device * device = calloc(1, sizeof(*device));
                         if (device != NULL) {
+                            device->replay = -1;
+                            struct capture_device info = { .source = CAPTURE_SOURCE_HID, .name = current->path,
+                                .vendor = current->vendor_id, .product = current->product_id,
+                                .interface_number = current->interface_number };
+                            device->capture = capture_add_device(&info);
                             device->driver = drivers[driver];
                             device->device = device_internal;
                             device->hid = drivers[driver]->get_hid_device(device_internal);
+                            if (current->path != NULL) {
+                                device->path = strdup(current->path);
+                            }
                             GHID_CALLBACKS callbacks = {
                                     .fp_read = read_callback,
                                     .fp_write = write_callback,
                                     .fp_close = close_callback,
-                                    .fp_register = poll_interface->fp_register,
-                                    .fp_remove = poll_interface->fp_remove,
+                                    .fp_register = fp_register,
+                                    .fp_remove = fp_remove,
                             };
                             if (ghid_register(device->hid, device, &callbacks) < 0) {
                                 close_device(device);
-                                free(device);
                             } else {
                                 GLIST_ADD(hidinput_devices, device);
                             }
@@ -165,16 +209,78 @@ int hidinput_init(const GPOLL_INTERFACE * poll_interface, int(*callback)(GE_Even
         }
     }
     ghid_free_enumeration(hid_devs);
+}
+
+int hidinput_init(const GPOLL_INTERFACE * poll_interface, int(*callback)(GE_Event*)) {
+
+    if (callback == NULL) {
+      PRINT_ERROR_OTHER("callback is NULL");
+      return -1;
+    }
+
+    if (poll_interface->fp_register == NULL) {
+        PRINT_ERROR_OTHER("fp_register_fd is NULL");
+        return -1;
+    }
+
+    if (poll_interface->fp_remove == NULL) {
+        PRINT_ERROR_OTHER("fp_remove is NULL");
+        return -1;
+    }
+
+    fp_register = poll_interface->fp_register;
+    fp_remove = poll_interface->fp_remove;
+
+    unsigned int driver;
+    for (driver = 0; driver < nb_drivers; ++driver) {
+        drivers[driver]->init(callback);
+    }
+
+    open_devices();
+
+    // the devices that disconnect once opened are waited for all at once
+    int enumerate = 0;
+    for (driver = 0; driver < nb_drivers; ++driver) {
+        if (drivers[driver]->wait != NULL && drivers[driver]->wait() > 0) {
+            enumerate = 1;
+        }
+    }
+    if (enumerate) {
+        open_devices();
+    }
 
     return 0;
 }
 
+int hidinput_register_hid(struct ghid_device * hid, void * user, const GHID_CALLBACKS * callbacks) {
+
+    if (fp_register == NULL) {
+        PRINT_ERROR_OTHER("hidinput is not initialized");
+        return -1;
+    }
+
+    GHID_CALLBACKS registered = *callbacks;
+    registered.fp_register = fp_register;
+    registered.fp_remove = fp_remove;
+
+    return ghid_register(hid, user, &registered);
+}
+
+void hidinput_hotplug() {
+
+    if (fp_register == NULL) {
+        return;
+    }
+
+    open_devices();
+}
+
 int hidinput_poll() {
 
     int ret = 0;
     struct hidinput_device * device;
     for (device = GLIST_BEGIN(hidinput_devices); device != GLIST_END(hidinput_devices); device = device->next) {
-        if (device->read_pending == 0) {
+        if (device->read_pending == 0 && device->hid != NULL) {
             if (ghid_poll(device->hid) < 0) {
                 ret = -1;
             } else {
@@ -182,12 +288,135 @@ int hidinput_poll() {
             }
         }
     }
+
+    int enumerate = 0;
+    unsigned int driver;
+    for (driver = 0; driver < nb_drivers; ++driver) {
+        if (drivers[driver]->poll != NULL && drivers[driver]->poll() > 0) {
+            enumerate = 1;
+        }
+    }
+    if (enumerate && fp_register != NULL) {
+        open_devices();
+    }
+
     return ret;
 }
 
 void hidinput_quit() {
 
     GLIST_CLEAN_ALL(hidinput_devices, close_device)
+
+    unsigned int driver;
+    for (driver = 0; driver < nb_drivers; ++driver) {
+        if (drivers[driver]->quit != NULL) {
+            drivers[driver]->quit();
+        }
+    }
+
+    fp_register = NULL;
+    fp_remove = NULL;
+}
+
+int hidinput_init_capture(int(*callback)(GE_Event*)) {
+
+    if (callback == NULL) {
+      PRINT_ERROR_OTHER("callback is NULL");
+      return -1;
+    }
+
+    unsigned int driver;
+    for (driver = 0; driver < nb_drivers; ++driver) {
+        drivers[driver]->init(callback);
+    }
+
+    return 0;
+}
+
+/*
+ * Give a captured device to the driver that would have opened it.
+ */
+int hidinput_open_capture(int id, const struct capture_device * capture) {
+
+    struct ghid_device_info info = {
+            .vendor_id = capture->vendor,
+            .product_id = capture->product,
+            .interface_number = capture->interface_number,
+            .path = (char *) capture->name,
+    };
+
+    unsigned int driver;
+    for (driver = 0; driver < nb_drivers; ++driver) {
+        if (drivers[driver]->open_capture == NULL) {
+            continue;
+        }
+        unsigned int i;
+        for (i = 0; drivers[driver]->ids[i].vendor_id != 0; ++i) {
+            if (drivers[driver]->ids[i].vendor_id == info.vendor_id
+                    && drivers[driver]->ids[i].product_id == info.product_id
+                    && (drivers[driver]->ids[i].interface_number == -1
+                            || drivers[driver]->ids[i].interface_number == info.interface_number)) {
+                struct hidinput_device_internal * device_internal = drivers[driver]->open_capture(&info);
+                if (device_internal == NULL) {
+                    return -1;
+                }
+                struct hidinput_device * device = calloc(1, sizeof(*device));
+                if (device == NULL) {
+                    PRINT_ERROR_ALLOC_FAILED("calloc");
+                    drivers[driver]->close(device_internal);
+                    return -1;
+                }
+                device->driver = drivers[driver];
+                device->device = device_internal;
+                device->path = strdup(capture->name);
+                device->capture = -1;
+                device->replay = id;
+                GLIST_ADD(hidinput_devices, device);
+                return 0;
+            }
+        }
+    }
+
+    return -1; // no driver can replay this device
+}
+
+static struct hidinput_device * get_replayed(int id) {
+
+    struct hidinput_device * device;
+    for (device = GLIST_BEGIN(hidinput_devices); device != GLIST_END(hidinput_devices); device = device->next) {
+        if (device->replay == id) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+void hidinput_process_capture(int id, const void * data, unsigned int size) {
+
+    struct hidinput_device * device = get_replayed(id);
+    if (device != NULL) {
+        process_report(device, data, size);
+    }
+}
+
+void hidinput_close_capture(int id) {
+
+    struct hidinput_device * device = get_replayed(id);
+    if (device != NULL) {
+        close_device(device);
+    }
+}
+
+int hidinput_get_stats(int joystick, GE_Stats * stats) {
+
+    struct hidinput_device * device;
+    for (device = GLIST_BEGIN(hidinput_devices); device != GLIST_END(hidinput_devices); device = device->next) {
+        if (device->driver->get_joystick != NULL && device->driver->get_joystick(device->device) == joystick) {
+            return STATS_GET(device, stats);
+        }
+    }
+
+    return -1;
 }
 
 int hidinput_set_callbacks(void * dev, void * user, int (* write_cb)(void * user, int transfered), int (* close_cb)(void * user)) {
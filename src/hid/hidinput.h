@@ -11,6 +11,7 @@
 #include <gimxpoll/include/gpoll.h>
 
 struct hidinput_device_internal;
+struct capture_device;
 
 typedef struct {
     unsigned short vendor_id;
@@ -25,20 +26,50 @@ typedef struct {
     // Open a device.
     // Synchronous transfers are allowed in this function.
     struct hidinput_device_internal * (* open)(const struct ghid_device_info * dev);
+    // Open a device that has no ghid_device, to replay a capture (optional).
+    struct hidinput_device_internal * (* open_capture)(const struct ghid_device_info * dev);
     // Get the ghid_device.
     struct ghid_device * (* get_hid_device)(struct hidinput_device_internal * device);
     // Process a report.
     int (* process)(struct hidinput_device_internal * device, const void * report, unsigned int size);
     // Close a device.
     int (* close)(struct hidinput_device_internal * device);
+    // Get the joystick index of a device (optional).
+    int (* get_joystick)(struct hidinput_device_internal * device);
+    // Periodic processing (optional).
+    // Return 1 if the HID devices have to be enumerated again, to open new devices.
+    int (* poll)(void);
+    // Wait for the devices that were left to reappear during the init (optional).
+    // Return 1 if the HID devices have to be enumerated again, to open new devices.
+    int (* wait)(void);
+    // Release the driver resources (optional).
+    void (* quit)(void);
 } s_hidinput_driver;
 
 int hidinput_register(s_hidinput_driver * driver);
 
 int hidinput_init(const GPOLL_INTERFACE * poll_interface, int(*callback)(GE_Event*));
 int hidinput_poll();
+// Open the matching devices that were plugged after hidinput_init.
+void hidinput_hotplug();
+// Get the statistics of a joystick, with the sources locked: the loop callbacks close the devices.
+int hidinput_get_stats(int joystick, GE_Stats * stats);
 void hidinput_quit();
 
+// Replay captured devices, instead of opening the HID devices.
+int hidinput_init_capture(int(*callback)(GE_Event*));
+int hidinput_open_capture(int id, const struct capture_device * capture);
+void hidinput_process_capture(int id, const void * data, unsigned int size);
+void hidinput_close_capture(int id);
+
+// Report the end of the native mode switches of Logitech wheels (logitechwheel.c).
+void logitechwheel_set_native_mode_callback(void (* callback)(const char * path, unsigned short product_id, int status));
+// Switch Logitech wheels asynchronously, if the devices that appear after init are opened (logitechwheel.c).
+void logitechwheel_set_hotplug(int enable);
+
+// Register a device that a driver opens outside of the enumeration, for asynchronous transfers.
+int hidinput_register_hid(struct ghid_device * hid, void * user, const GHID_CALLBACKS * callbacks);
+
 int hidinput_set_callbacks(void * dev, void * user, int (* write_cb)(void * user, int transfered), int (* close_cb)(void * user));
 
 #endif /* HIDINPUT_H_ */
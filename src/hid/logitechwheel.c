@@ -568,75 +568,307 @@ static s_native_mode * get_native_mode_command(unsigned short product, unsigned
 }
 
 #ifndef WIN32
-static int send_native_mode(const struct ghid_device_info * dev, const s_native_mode * native_mode) {
+/*
+ * Native mode switching is asynchronous: the wheel disconnects once it receives the command,
+ * and reconnects with a different product id, but with the same path (this only works on GNU/Linux,
+ * on Windows the device path is expected to change).
+ * The command is written asynchronously, and the wheel is left open until it disconnects.
+ * With hotplug, the device is opened once it reappears, either through hotplug, or through the periodic check.
+ * Several wheels can be switched in parallel.
+ * Without hotplug, the joystick nodes are only scanned once, after the HID devices are opened:
+ * the commands are sent to all the wheels, then the init waits once for all of them to reappear,
+ * so that their joystick nodes are there for the scan.
+ */
 
-    struct ghid_device * device = ghid_open_path(dev->path);
-    if (device == NULL) {
-        return -1;
+#define NATIVE_MODE_CHECK_PERIOD 1000000000LL // check every second
+#define NATIVE_MODE_TIMEOUT 5000000000LL // give up after 5 seconds
+
+struct native_mode_switch {
+    char * path;
+    struct ghid_device * hid; // the wheel before it disconnects
+    unsigned short product_id; // the product id in native mode
+    gtime deadline;
+    GLIST_LINK(struct native_mode_switch);
+};
+
+static GLIST_INST(struct native_mode_switch, native_mode_switches);
+
+static gtime next_check = 0;
+
+static int hotplug = 0;
+
+void logitechwheel_set_hotplug(int enable) {
+
+    hotplug = enable;
+}
+
+static void (* native_mode_callback)(const char * path, unsigned short product_id, int status) = NULL;
+
+void logitechwheel_set_native_mode_callback(void (* callback)(const char * path, unsigned short product_id, int status)) {
+
+    native_mode_callback = callback;
+}
+
+static struct native_mode_switch * get_native_mode_switch(const char * path) {
+
+    struct native_mode_switch * current;
+    for (current = GLIST_BEGIN(native_mode_switches); current != GLIST_END(native_mode_switches); current = current->next) {
+        if (strcmp(current->path, path) == 0) {
+            return current;
+        }
+    }
+    return NULL;
+}
+
+static void close_native_mode_switch(struct native_mode_switch * sw) {
+
+    if (sw->hid != NULL) {
+        ghid_close(sw->hid);
+        sw->hid = NULL;
+    }
+}
+
+static void free_native_mode_switch(struct native_mode_switch * sw) {
+
+    close_native_mode_switch(sw);
+    GLIST_REMOVE(native_mode_switches, sw);
+    free(sw->path);
+    free(sw);
+}
+
+static void end_native_mode_switch(struct native_mode_switch * sw, int status) {
+
+    if (status == 0) {
+        if (GLOG_LEVEL(GLOG_NAME,INFO)) {
+            printf("native mode enabled for HID device %s (PID=%04x)\n", sw->path, sw->product_id);
+        }
+    } else {
+        if (GLOG_LEVEL(GLOG_NAME,ERROR)) {
+            fprintf(stderr, "failed to enable native mode for HID device %s\n", sw->path);
+        }
     }
-    int ret = ghid_write_timeout(device, native_mode->command, sizeof(native_mode->command), 1000);
-    if (ret <= 0) {
+
+    if (native_mode_callback != NULL) {
+        native_mode_callback(sw->path, sw->product_id, status);
+    }
+
+    free_native_mode_switch(sw);
+}
+
+static int native_mode_read(void * user __attribute__((unused)), const void * buf __attribute__((unused)),
+        int status __attribute__((unused))) {
+
+    return 0; // the wheel is only opened once it is in native mode
+}
+
+static int native_mode_written(void * user, int status) {
+
+    struct native_mode_switch * sw = (struct native_mode_switch *) user;
+
+    if (status <= 0) {
         if (GLOG_LEVEL(GLOG_NAME,ERROR)) {
-            fprintf(stderr, "failed to send native mode command for HID device %s (PID=%04x)\n", dev->path, dev->product_id);
+            fprintf(stderr, "failed to send native mode command for HID device %s\n", sw->path);
         }
-        ret = -1;
     } else {
         if (GLOG_LEVEL(GLOG_NAME,INFO)) {
-            printf("native mode command sent to HID device %s (PID=%04x)\n", dev->path, dev->product_id);
+            printf("native mode command sent to HID device %s\n", sw->path);
         }
-        ret = 0;
     }
-    ghid_close(device);
-    return ret;
+    return 0;
 }
 
-static int check_native_mode(const struct ghid_device_info * dev, unsigned short product_id) {
+static int native_mode_closed(void * user) {
+
+    struct native_mode_switch * sw = (struct native_mode_switch *) user;
+
+    // the wheel disconnected to switch to native mode
+    close_native_mode_switch(sw);
+    return 0;
+}
+
+/*
+ * Open the wheel and write the native mode command asynchronously.
+ */
+static int send_native_mode(struct native_mode_switch * sw, const s_native_mode * native_mode) {
 
-    // wait up to 5 seconds for the device to enable native mode
-    int reset = 0;
-    int cpt = 0;
-    do {
-        // sleep 1 second between each retry
-        int i;
-        for (i = 0; i < 10; ++i) {
-            usleep(100000);
+    sw->hid = ghid_open_path(sw->path);
+    if (sw->hid == NULL) {
+        return -1;
+    }
+    GHID_CALLBACKS callbacks = {
+            .fp_read = native_mode_read,
+            .fp_write = native_mode_written,
+            .fp_close = native_mode_closed,
+    };
+    if (hidinput_register_hid(sw->hid, sw, &callbacks) < 0
+            || ghid_write(sw->hid, native_mode->command, sizeof(native_mode->command)) < 0) {
+        if (GLOG_LEVEL(GLOG_NAME,ERROR)) {
+            fprintf(stderr, "failed to send native mode command for HID device %s\n", sw->path);
         }
-        ++cpt;
-        struct ghid_device_info * hid_devs = ghid_enumerate(USB_VENDOR_ID_LOGITECH, product_id);
-        struct ghid_device_info * current;
-        for (current = hid_devs; current != NULL && reset == 0; current = current->next) {
-            // Warning: this only works on GNU/Linux, on Windows the device path is expected to change
-            if (strcmp(current->path, dev->path) == 0) {
-                if (GLOG_LEVEL(GLOG_NAME,INFO)) {
-                    printf("native mode enabled for HID device %s (PID=%04x)\n", dev->path, product_id);
-                }
-                reset = 1;
-            }
+        close_native_mode_switch(sw);
+        return -1;
+    }
+    return 0;
+}
+
+static int start_native_mode_switch(const struct ghid_device_info * dev, const s_native_mode * native_mode) {
+
+    if (get_native_mode_switch(dev->path) != NULL) {
+        return 0; // the device was enumerated again before disconnecting
+    }
+
+    struct native_mode_switch * sw = calloc(1, sizeof(*sw));
+    if (sw == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        return -1;
+    }
+
+    sw->path = strdup(dev->path);
+    if (sw->path == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("strdup");
+        free(sw);
+        return -1;
+    }
+
+    if (send_native_mode(sw, native_mode) < 0) {
+        free(sw->path);
+        free(sw);
+        return -1;
+    }
+
+    gtime now = gtime_gettime();
+
+    sw->product_id = native_mode->product_id;
+    sw->deadline = now + NATIVE_MODE_TIMEOUT;
+
+    if (GLIST_BEGIN(native_mode_switches) == GLIST_END(native_mode_switches)) {
+        next_check = now + NATIVE_MODE_CHECK_PERIOD;
+    }
+
+    GLIST_ADD(native_mode_switches, sw);
+
+    return 0;
+}
+
+static int is_handled(unsigned short product_id) {
+
+    unsigned int i;
+    for (i = 0; ids[i].vendor_id != 0; ++i) {
+        if (ids[i].product_id == product_id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Tell if the wheel of a pending switch reappeared with its native product id.
+ */
+static int is_in_native_mode(const struct native_mode_switch * sw) {
+
+    int found = 0;
+    struct ghid_device_info * hid_devs = ghid_enumerate(USB_VENDOR_ID_LOGITECH, sw->product_id);
+    struct ghid_device_info * current;
+    for (current = hid_devs; current != NULL && found == 0; current = current->next) {
+        if (strcmp(current->path, sw->path) == 0) {
+            found = 1;
+        }
+    }
+    ghid_free_enumeration(hid_devs);
+    return found;
+}
+
+/*
+ * End the switches of the wheels that reappeared in native mode, and of the ones that timed out.
+ * Return 1 if a wheel that is handled by this driver reappeared, so that it gets opened.
+ */
+static int check_native_mode_switches(gtime now) {
+
+    int reopen = 0;
+
+    struct native_mode_switch * sw = GLIST_BEGIN(native_mode_switches);
+    while (sw != GLIST_END(native_mode_switches)) {
+        struct native_mode_switch * next = sw->next;
+        if (is_in_native_mode(sw)) {
+            // the device is opened by the next enumeration if it is handled by this driver, else by the OS
+            reopen |= is_handled(sw->product_id);
+            end_native_mode_switch(sw, 0);
+        } else if (now >= sw->deadline) {
+            end_native_mode_switch(sw, -1);
         }
-        ghid_free_enumeration(hid_devs);
-    } while (cpt < 5 && !reset);
+        sw = next;
+    }
 
-    return (reset == 1) ? 0 : -1;
+    return reopen;
 }
 
+/*
+ * Check the pending switches, for wheels that are not reported through hotplug.
+ */
+static int poll_native_mode_switches(void) {
+
+    if (GLIST_BEGIN(native_mode_switches) == GLIST_END(native_mode_switches)) {
+        return 0;
+    }
+
+    gtime now = gtime_gettime();
+    if (now < next_check) {
+        return 0;
+    }
+    next_check = now + NATIVE_MODE_CHECK_PERIOD;
+
+    return check_native_mode_switches(now);
+}
+
+/*
+ * Without hotplug, wait for all the wheels to reappear in native mode, checking every 100ms.
+ * The commands were sent during the same enumeration, so the switches share the same deadline.
+ */
+static int wait_native_mode_switches(void) {
+
+    if (hotplug) {
+        return 0;
+    }
+
+    int reopen = 0;
+
+    while (GLIST_BEGIN(native_mode_switches) != GLIST_END(native_mode_switches)) {
+        usleep(100000);
+        reopen |= check_native_mode_switches(gtime_gettime());
+    }
+
+    return reopen;
+}
+
+static void quit_native_mode_switches(void) {
+
+    while (GLIST_BEGIN(native_mode_switches) != GLIST_END(native_mode_switches)) {
+        free_native_mode_switch(GLIST_BEGIN(native_mode_switches));
+    }
+}
+
+/*
+ * Return 1 if the device has to be opened, 0 if it is switching to native mode, or -1 in case of error.
+ */
 static int set_native_mode(const struct ghid_device_info * dev, const s_native_mode * native_mode) {
 
     if (native_mode) {
-        if (send_native_mode(dev, native_mode) < 0) {
-            return -1;
-        }
-        if (check_native_mode(dev, native_mode->product_id) < 0) {
-            if (GLOG_LEVEL(GLOG_NAME,ERROR)) {
-                fprintf(stderr, "failed to enable native mode for HID device %s\n", dev->path);
-            }
+        if (start_native_mode_switch(dev, native_mode) < 0) {
             return -1;
         }
+        return 0;
+    }
+
+    struct native_mode_switch * sw = get_native_mode_switch(dev->path);
+    if (sw != NULL) {
+        // the device reappeared in native mode
+        end_native_mode_switch(sw, 0);
     } else {
         if (GLOG_LEVEL(GLOG_NAME,INFO)) {
             printf("native mode is already enabled for HID device %s (PID=%04x)\n", dev->path, dev->product_id);
         }
     }
-    return 0;
+    return 1;
 }
 #else
 static int set_native_mode(const struct ghid_device_info * dev __attribute__((unused)), const s_native_mode * native_mode) {
@@ -687,14 +919,14 @@ static int set_native_mode(const struct ghid_device_info * dev __attribute__((un
             }
         }
     }
-    return 0;
+    return 1;
 }
 #endif
 
 static struct hidinput_device_internal *  open_device(const struct ghid_device_info * dev) {
 
     s_native_mode * native_mode = get_native_mode_command(dev->product_id, dev->bcdDevice);
-    if (set_native_mode(dev, native_mode) < 0) {
+    if (set_native_mode(dev, native_mode) <= 0) {
         return NULL;
     }
 
@@ -746,13 +978,34 @@ static struct ghid_device * get_hid_device(struct hidinput_device_internal * dev
     return device->hid;
 }
 
+#ifdef WIN32
+void logitechwheel_set_native_mode_callback(void (* callback)(const char * path, unsigned short product_id, int status) __attribute__((unused))) {
+
+}
+
+void logitechwheel_set_hotplug(int enable __attribute__((unused))) {
+
+}
+#endif
+
 static s_hidinput_driver driver = {
         .ids = ids,
         .init = init,
         .open = open_device,
+        .open_capture = NULL,
         .get_hid_device = get_hid_device,
         .process = process,
         .close = close_device,
+        .get_joystick = NULL,
+#ifndef WIN32
+        .poll = poll_native_mode_switches,
+        .wait = wait_native_mode_switches,
+        .quit = quit_native_mode_switches,
+#else
+        .poll = NULL,
+        .wait = NULL,
+        .quit = NULL,
+#endif
 };
 
 void logitechwheel_constructor(void) __attribute__((constructor));
@@ -4,6 +4,7 @@
  */
 
 #include "hidinput.h"
+#include "../events.h"
 #ifndef WIN32
 #include <arpa/inet.h>
 #else
@@ -69,7 +70,7 @@ static int close_device(struct hidinput_device_internal * device) {
     }
 
     if (device->joystick >= 0) {
-        // TODO MLA: remove joystick
+        ev_joystick_remove(device->joystick);
     }
 
     GLIST_REMOVE(sc_devices, device);
@@ -232,23 +233,17 @@ static int process(struct hidinput_device_internal * device, const void * report
     return 0;
 }
 
-static struct hidinput_device_internal * open_device(const struct ghid_device_info * dev) {
-
-    struct ghid_device * hid = ghid_open_path(dev->path);
-    if (hid == NULL) {
-        return NULL;
-    }
+static struct hidinput_device_internal * add_device(struct ghid_device * hid) {
 
     struct hidinput_device_internal * device = calloc(1, sizeof(*device));
     if (device == NULL) {
         PRINT_ERROR_ALLOC_FAILED("calloc");
-        ghid_close(hid);
         return NULL;
     }
 
-    device->joystick = ginput_register_joystick(STEAM_CONTROLLER_NAME, GE_HAPTIC_NONE, NULL);
+    // devices may be opened after ginput_init (hotplug), so that the public registration function can't be used
+    device->joystick = ev_joystick_register(STEAM_CONTROLLER_NAME, GE_HAPTIC_NONE, NULL);
     if (device->joystick < 0) {
-        ghid_close(hid);
         free(device);
         return NULL;
     }
@@ -260,18 +255,48 @@ static struct hidinput_device_internal * open_device(const struct ghid_device_in
     return device;
 }
 
+static struct hidinput_device_internal * open_device(const struct ghid_device_info * dev) {
+
+    struct ghid_device * hid = ghid_open_path(dev->path);
+    if (hid == NULL) {
+        return NULL;
+    }
+
+    struct hidinput_device_internal * device = add_device(hid);
+    if (device == NULL) {
+        ghid_close(hid);
+    }
+
+    return device;
+}
+
+static struct hidinput_device_internal * open_capture(const struct ghid_device_info * dev __attribute__((unused))) {
+
+    return add_device(NULL);
+}
+
 static struct ghid_device * get_hid_device(struct hidinput_device_internal * device) {
 
     return device->hid;
 }
 
+static int get_joystick(struct hidinput_device_internal * device) {
+
+    return device->joystick;
+}
+
 static s_hidinput_driver driver = {
         .ids = ids,
         .init = init,
         .open = open_device,
+        .open_capture = open_capture,
         .get_hid_device = get_hid_device,
         .process = process,
         .close = close_device,
+        .get_joystick = get_joystick,
+        .poll = NULL,
+        .wait = NULL,
+        .quit = NULL,
 };
 
 void steamcontroller_constructor(void) __attribute__((constructor));
@@ -13,6 +13,7 @@
 #include <termios.h>
 #include <poll.h>
 #include <sys/signalfd.h>
+#include <sys/inotify.h>
 #include <math.h>
 #include <string.h>
 
@@ -20,6 +21,9 @@
 #include <gimxcommon/include/gerror.h>
 #include <gimxlog/include/glog.h>
 
+#include "../dispatch.h"
+#include "../hid/hidinput.h"
+
 GLOG_GET(GLOG_NAME)
 
 static int mkb_source = -1;
@@ -56,6 +60,22 @@ void ev_register_js_source(struct js_source * source) {
     jsource = source;
 }
 
+struct js_source * ev_get_js_source() {
+
+    return jsource;
+}
+
+struct mkb_source * ev_get_mkb_source(int src) {
+
+    switch (src) {
+    case GE_MKB_SOURCE_PHYSICAL:
+        return source_physical;
+    case GE_MKB_SOURCE_WINDOW_SYSTEM:
+        return source_window;
+    }
+    return NULL;
+}
+
 #define CHECK_JS_SOURCE(RETVAL) \
     do { \
         if (jsource == NULL) { \
@@ -118,6 +138,219 @@ void ev_joystick_close(int id) {
     jsource->close(id);
 }
 
+void ev_joystick_remove(int id) {
+
+    CHECK_JS_SOURCE();
+
+    if (jsource->remove != NULL) {
+        jsource->remove(id);
+    } else {
+        jsource->close(id);
+    }
+}
+
+#define DEV "/dev"
+#define DEV_INPUT "/dev/input"
+
+static struct {
+    int fd;
+    int wd_input;
+    int wd_dev;
+    GPOLL_REMOVE_FD fp_remove;
+} hotplug = { .fd = -1 };
+
+static void hotplug_open(int wd, const char * node) {
+
+    unsigned int num;
+    if (wd == hotplug.wd_input) {
+        if (sscanf(node, "js%u", &num) == 1) {
+            if (jsource != NULL && jsource->open != NULL) {
+                jsource->open(node);
+            }
+        } else if (sscanf(node, "event%u", &num) == 1) {
+            // event devices are opened by the joystick source as well with the evdev backend
+            if (jsource != NULL && jsource->open != NULL) {
+                jsource->open(node);
+            }
+            if (mkbsource != NULL && mkbsource->open != NULL) {
+                mkbsource->open(node);
+            }
+        }
+    } else if (wd == hotplug.wd_dev) {
+        if (sscanf(node, "hidraw%u", &num) == 1) {
+            hidinput_hotplug();
+        }
+    }
+}
+
+static int hotplug_process(void * user __attribute__((unused))) {
+
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    ssize_t len;
+    while ((len = read(hotplug.fd, buf, sizeof(buf))) > 0) {
+        const struct inotify_event * event;
+        char * ptr;
+        for (ptr = buf; ptr < buf + len; ptr += sizeof(*event) + event->len) {
+            event = (const struct inotify_event *) ptr;
+            // removals are detected when reading the devices
+            if (event->len > 0 && (event->mask & (IN_CREATE | IN_ATTRIB))) {
+                hotplug_open(event->wd, event->name);
+            }
+        }
+    }
+
+    dispatch_flush();
+
+    return 0;
+}
+
+static int hotplug_close(void * user __attribute__((unused))) {
+
+    if (hotplug.fd >= 0) {
+        hotplug.fp_remove(hotplug.fd);
+        close(hotplug.fd);
+        hotplug.fd = -1;
+    }
+
+    if (jsource != NULL && jsource->set_hotplug != NULL) {
+        jsource->set_hotplug(0);
+    }
+    if (mkbsource != NULL && mkbsource->set_hotplug != NULL) {
+        mkbsource->set_hotplug(0);
+    }
+
+    return 0;
+}
+
+/*
+ * Watch /dev/input for jsX and eventX nodes, and /dev for hidrawX nodes.
+ * Device nodes are usually created before their permissions are set (by udev),
+ * so that opening is attempted on creation and on attribute changes.
+ */
+int ev_hotplug_init(const GPOLL_INTERFACE * poll_interface) {
+
+    hotplug.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (hotplug.fd < 0) {
+        PRINT_ERROR_ERRNO("inotify_init1");
+        return -1;
+    }
+
+    hotplug.wd_input = inotify_add_watch(hotplug.fd, DEV_INPUT, IN_CREATE | IN_ATTRIB);
+    if (hotplug.wd_input < 0) {
+        PRINT_ERROR_ERRNO("inotify_add_watch");
+        close(hotplug.fd);
+        hotplug.fd = -1;
+        return -1;
+    }
+
+    hotplug.wd_dev = inotify_add_watch(hotplug.fd, DEV, IN_CREATE | IN_ATTRIB);
+    if (hotplug.wd_dev < 0) {
+        PRINT_ERROR_ERRNO("inotify_add_watch");
+        close(hotplug.fd);
+        hotplug.fd = -1;
+        return -1;
+    }
+
+    hotplug.fp_remove = poll_interface->fp_remove;
+
+    GPOLL_CALLBACKS callbacks = { .fp_read = hotplug_process, .fp_write = NULL, .fp_close = hotplug_close };
+    if (poll_interface->fp_register(hotplug.fd, NULL, &callbacks) < 0) {
+        close(hotplug.fd);
+        hotplug.fd = -1;
+        return -1;
+    }
+
+    if (jsource != NULL && jsource->set_hotplug != NULL) {
+        jsource->set_hotplug(1);
+    }
+    if (mkbsource != NULL && mkbsource->set_hotplug != NULL) {
+        mkbsource->set_hotplug(1);
+    }
+
+    return 0;
+}
+
+void ev_set_motion_mode(GE_MotionMode mode) {
+
+    if (source_physical != NULL && source_physical->set_motion_mode != NULL) {
+        source_physical->set_motion_mode(mode);
+    }
+    if (source_window != NULL && source_window->set_motion_mode != NULL) {
+        source_window->set_motion_mode(mode);
+    }
+}
+
+void ev_set_hat_mode(GE_HatMode mode) {
+
+    if (jsource != NULL && jsource->set_hat_mode != NULL) {
+        jsource->set_hat_mode(mode);
+    }
+}
+
+void ev_set_haptic_rate(unsigned int rate) {
+
+    if (jsource != NULL && jsource->set_haptic_rate != NULL) {
+        jsource->set_haptic_rate(rate);
+    }
+}
+
+void ev_update_event_masks() {
+
+    if (jsource != NULL && jsource->update_event_masks != NULL) {
+        jsource->update_event_masks();
+    }
+    if (mkbsource != NULL && mkbsource->update_event_masks != NULL) {
+        mkbsource->update_event_masks();
+    }
+}
+
+int ev_get_stats(GE_DeviceType type, int id, GE_Stats * stats) {
+
+    switch (type) {
+    case GE_DEVICE_JOYSTICK:
+        if (jsource != NULL && jsource->get_stats != NULL) {
+            return jsource->get_stats(id, stats);
+        }
+        break;
+    case GE_DEVICE_MOUSE:
+        if (mkbsource != NULL && mkbsource->get_mouse_stats != NULL) {
+            return mkbsource->get_mouse_stats(id, stats);
+        }
+        break;
+    case GE_DEVICE_KEYBOARD:
+        if (mkbsource != NULL && mkbsource->get_keyboard_stats != NULL) {
+            return mkbsource->get_keyboard_stats(id, stats);
+        }
+        break;
+    }
+
+    return -1;
+}
+
+int ev_get_overflows(GE_DeviceType type, int id, uint64_t * overflows) {
+
+    switch (type) {
+    case GE_DEVICE_JOYSTICK:
+        if (jsource != NULL && jsource->get_overflows != NULL) {
+            return jsource->get_overflows(id, overflows);
+        }
+        break;
+    case GE_DEVICE_MOUSE:
+        if (mkbsource != NULL && mkbsource->get_mouse_overflows != NULL) {
+            return mkbsource->get_mouse_overflows(id, overflows);
+        }
+        break;
+    case GE_DEVICE_KEYBOARD:
+        if (mkbsource != NULL && mkbsource->get_keyboard_overflows != NULL) {
+            return mkbsource->get_keyboard_overflows(id, overflows);
+        }
+        break;
+    }
+
+    return -1;
+}
+
 int ev_grab_input(int mode) {
 
     CHECK_MKB_SOURCE(-1);
@@ -127,6 +360,8 @@ int ev_grab_input(int mode) {
 
 void ev_quit(void) {
 
+    hotplug_close(NULL);
+
     if (mkbsource != NULL) {
         mkbsource->quit();
     }
@@ -182,7 +417,22 @@ void * ev_joystick_get_hid(int joystick) {
     return jsource->get_hid(joystick);
 }
 
+int ev_set_joystick_backend(GE_JoystickBackend backend) {
+
+    CHECK_JS_SOURCE(-1);
+
+    if (jsource->set_backend == NULL) {
+        PRINT_ERROR_OTHER("the joystick source has a single backend");
+        return -1;
+    }
+
+    return jsource->set_backend(backend);
+}
+
 void ev_sync_process() {
 
-    // All inputs are asynchronous on Linux!
+    // All inputs are asynchronous on Linux, this only flushes the deferred force feedback updates.
+    if (jsource != NULL && jsource->sync_process != NULL) {
+        jsource->sync_process();
+    }
 }
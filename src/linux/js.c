@@ -12,12 +12,20 @@
 #include <string.h>
 #include <stdlib.h>
 #include <dirent.h>
+#include <time.h>
+#include <pthread.h>
 #include <ginput.h>
 #include <gimxpoll/include/gpoll.h>
 #include <gimxcommon/include/gerror.h>
 #include <gimxcommon/include/glist.h>
 #include <gimxlog/include/glog.h>
 #include "../events.h"
+#include "../timestamp.h"
+#include "../dispatch.h"
+#include "../stats.h"
+#include "../mask.h"
+#include "../capture.h"
+#include "readbuf.h"
 
 #define eprintf(...) if(debug) printf(__VA_ARGS__)
 
@@ -27,6 +35,16 @@ static int debug = 0;
 
 #define AXMAP_SIZE (ABS_MAX + 1)
 
+#ifndef input_event_sec
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+#define EVENT_TIME(IE) ((gtime) (IE)->input_event_sec * 1000000000ULL + (gtime) (IE)->input_event_usec * 1000ULL)
+
+#define LONG_BITS (sizeof(long) * 8)
+#define NLONGS(x) (((x) + LONG_BITS - 1) / LONG_BITS)
+
 static GPOLL_REMOVE_SOURCE fp_remove = NULL;
 
 static struct {
@@ -40,26 +58,90 @@ static struct {
         { FF_PERIODIC, GE_HAPTIC_SINE }
 };
 
+#define EFFECT_TYPES (sizeof(effect_types) / sizeof(*effect_types))
+
+/*
+ * The state of an effect, so that the effect is only uploaded if it changed,
+ * and only played or stopped when it gets active or inactive.
+ */
+struct effect_state {
+    struct ff_effect uploaded; // the last uploaded effect
+    int valid; // 1 if the effect was uploaded
+    struct ff_effect pending; // the effect to upload, when the update rate is limited
+    int has_pending;
+    int playing;
+    gtime last_update;
+};
+
+#define JS_AXES 256 // js axis numbers are 8-bit
+#define JS_BUTTONS 256 // js button numbers are 8-bit
+#define HAT_AXES (ABS_HAT3Y - ABS_HAT0X + 1)
+
+enum axis_kind {
+    AXIS_PLAIN,    // value = (value + offset) >> shift
+    AXIS_HAT,      // hat axis, converted to buttons or to hat motion
+};
+
+struct axis_info {
+    uint8_t kind;
+    uint8_t shift;
+    int16_t offset;
+    uint8_t hat_axis; // AXIS_HAT: 0 = ABS_HAT0X, 1 = ABS_HAT0Y ... 7 = ABS_HAT3Y
+    uint8_t buttons[3]; // AXIS_HAT: the emulated buttons, indexed by value + 1 (the middle one is unused)
+};
+
+/*
+ * The evdev backend reads the event device directly, and numbers the axes and the buttons
+ * the same way as the js interface, so that both backends generate the same events.
+ */
+struct evdev_map {
+    struct {
+        int number; // the js axis number, or -1 if the axis is not present
+        int32_t minimum;
+        int64_t scale; // 16.16 fixed point, from [minimum, maximum] to [0, 65534], 0 if maximum <= minimum
+        int32_t value; // the last value, to resync after a SYN_DROPPED
+    } abs[ABS_CNT];
+    int16_t buttons[KEY_CNT - BTN_MISC]; // the js button number, or -1 if the button is not present
+    unsigned long keys[NLONGS(KEY_CNT)]; // the button states, to resync after a SYN_DROPPED
+    unsigned long abs_masked[NLONGS(ABS_CNT)]; // the axes whose events the kernel drops (EVIOCSMASK)
+    int dropped; // 1 if the events are dropped until the next SYN_REPORT
+};
+
+/*
+ * The capture information of a joystick, followed by its evdev map with the evdev backend.
+ */
+struct js_capture_info {
+    uint32_t buttons;
+    uint8_t ax_map[AXMAP_SIZE];
+};
+
 struct joystick_device {
     int id; // the id of the joystick in the generated events
     int fd; // the opened joystick, or -1 in case the joystick was created using the js_add() function
+    int node; // the X in /dev/input/jsX (or eventX), or -1 in case the joystick was created using the js_add() function
+    struct evdev_map * evdev; // the evdev backend state, or NULL for the js backend
+    int monotonic; // evdev backend: 1 if event timestamps use CLOCK_MONOTONIC
+    uint64_t overflows; // evdev backend: the number of SYN_DROPPED, written by the reading thread only
     char* name; // the name of the joystick
     int isSixaxis;
+    struct axis_info axes[JS_AXES]; // indexed by the js axis number, built from the axis map at open time
+    int8_t hat_value[HAT_AXES]; // the current hat axis values (-1, 0 or 1)
     struct {
-        unsigned short button_nb; // the base index of the generated hat buttons equals the number of physical buttons
-        int hat_value[ABS_HAT3Y - ABS_HAT0X]; // the current hat values
-        uint8_t ax_map[AXMAP_SIZE]; // the axis map
-    } hat_info; // allows to convert hat axes to buttons
-    struct {
-        int fd; // the event device, or -1 in case the joystick was created using the js_add() function
+        int fd; // the event device (the same as fd with the evdev backend), or -1 if there is no force feedback
         unsigned int effects;
-        int ids[sizeof(effect_types) / sizeof(*effect_types)];
+        int ids[EFFECT_TYPES];
+        struct effect_state states[EFFECT_TYPES];
         int constant_id;
         int spring_id;
         int damper_id;
         int (*haptic_cb)(const GE_Event * event);
     } force_feedback;
     void * hid;
+    struct readbuf buffer; // js_event or input_event records
+    int capture; // the id of the device in the capture that is recorded, or -1
+    int replay; // the id of the device in the capture that is replayed, or -1 if it is not a replayed device
+    int closed; // 1 if the joystick was closed while its input was processed, see reading
+    STATS_FIELD
     GLIST_LINK(struct joystick_device);
 };
 
@@ -67,6 +149,14 @@ static struct joystick_device * indexToJoystick[GE_MAX_DEVICES] = { };
 
 static int j_num; // the number of joysticks
 
+static char * previous_names[GE_MAX_DEVICES] = { }; // the names of the removed joysticks, to reuse their index
+
+static int hotplug = 0;
+
+static GE_JoystickBackend backend = GE_JOYSTICK_BACKEND_JS;
+
+static gtime haptic_period = 0; // the minimum time between two updates of an effect, 0 means no limit
+
 #define CHECK_DEVICE(INDEX, RETVALUE) \
     if(INDEX < 0 || INDEX >= j_num || indexToJoystick[INDEX] == NULL) \
     { \
@@ -77,7 +167,41 @@ static int js_close_internal(void * user);
 
 static GLIST_INST(struct joystick_device, js_devices);
 
-int get_effect_id(struct joystick_device * device, GE_HapticType type) {
+/*
+ * The joystick whose input is processed by the current thread.
+ * The event callback may close it, it is then only freed once its input is processed.
+ */
+static __thread struct joystick_device * reading = NULL;
+
+static void js_free_device(struct joystick_device * device) {
+
+    free(device->evdev);
+    readbuf_free(&device->buffer);
+    free(device);
+}
+
+/*
+ * Finish processing the input of a joystick.
+ * Return -1 if it was closed meanwhile, in which case it is freed.
+ */
+static int js_end_read(struct joystick_device * device, struct joystick_device * previous) {
+
+    reading = previous;
+
+    if (device->closed) {
+        js_free_device(device);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * With several reader threads, joysticks of different threads may be removed at the same time.
+ */
+static pthread_mutex_t devices_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int get_effect_index(GE_HapticType type) {
     int i = -1;
     switch (type) {
     case GE_HAPTIC_RUMBLE:
@@ -98,6 +222,11 @@ int get_effect_id(struct joystick_device * device, GE_HapticType type) {
     case GE_HAPTIC_NONE:
         break;
     }
+    return i;
+}
+
+int get_effect_id(struct joystick_device * device, GE_HapticType type) {
+    int i = get_effect_index(type);
     if (i < 0) {
         return -1;
     }
@@ -106,78 +235,397 @@ int get_effect_id(struct joystick_device * device, GE_HapticType type) {
 
 static int (*event_callback)(GE_Event*) = NULL;
 
-static void js_process_event(struct joystick_device * device, struct js_event* je) {
-    GE_Event evt = { };
+static void js_report_device(int type, int id) {
+
+    GE_Event evt = { .device = { .type = type, .which = id } };
+    event_callback(&evt);
+    dispatch_flush();
+}
+
+/*
+ * A joystick that is plugged again gets the index it had before.
+ */
+static int js_allocate_index(const char * name) {
+
+    int i;
+    for (i = 0; i < j_num; ++i) {
+        if (indexToJoystick[i] == NULL && previous_names[i] != NULL && !strcmp(previous_names[i], name)) {
+            return i;
+        }
+    }
+    if (j_num < GE_MAX_DEVICES) {
+        return j_num;
+    }
+    for (i = 0; i < j_num; ++i) {
+        if (indexToJoystick[i] == NULL) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void js_set_index(struct joystick_device * device, int index) {
+
+    device->id = index;
+    indexToJoystick[index] = device;
+    if (index == j_num) {
+        ++j_num;
+    }
+}
+
+static int js_remove_device(void * user) {
+
+    struct joystick_device * device = (struct joystick_device *) user;
+
+    if (hotplug) {
+        js_report_device(GE_JOYDEVICEREMOVED, device->id);
+    }
+
+    return js_close_internal(device);
+}
+
+/*
+ * Compile the axis map into the axis table.
+ * Hat axes are converted to buttons numbered after the physical buttons, 4 per hat: up, right, down, left.
+ * Sixaxis pressure axes are rescaled from [-32767, 32767] to [0, 32767].
+ */
+static void js_compile_axes(struct joystick_device * device, const uint8_t ax_map[AXMAP_SIZE], unsigned int button_nb) {
+
+    unsigned int number;
+    for (number = 0; number < JS_AXES; ++number) {
+        struct axis_info * info = device->axes + number;
+        memset(info, 0x00, sizeof(*info));
+        int axis = (number < AXMAP_SIZE) ? ax_map[number] : -1;
+        if (axis >= ABS_HAT0X && axis <= ABS_HAT3Y) {
+            unsigned int hat_axis = axis - ABS_HAT0X;
+            unsigned int base = button_nb + 4 * (hat_axis / 2);
+            info->kind = AXIS_HAT;
+            info->hat_axis = hat_axis;
+            if (hat_axis % 2 == 0) {
+                info->buttons[0] = base + 3; // left
+                info->buttons[2] = base + 1; // right
+            } else {
+                info->buttons[0] = base + 0; // up
+                info->buttons[2] = base + 2; // down
+            }
+        } else if (device->isSixaxis && number > 3 && number < 23) {
+            info->offset = 32767;
+            info->shift = 1;
+        }
+    }
+}
+
+static GE_HatMode hat_mode = GE_HAT_MODE_BUTTONS;
+
+// hat values indexed by x + 1 and y + 1
+static const uint8_t hat_values[3][3] = {
+    { GE_HAT_LEFTUP,  GE_HAT_LEFT,     GE_HAT_LEFTDOWN },
+    { GE_HAT_UP,      GE_HAT_CENTERED, GE_HAT_DOWN },
+    { GE_HAT_RIGHTUP, GE_HAT_RIGHT,    GE_HAT_RIGHTDOWN },
+};
+
+static inline void js_report_event(struct joystick_device * device, GE_Event * evt) {
+
+    eprintf("event from joystick: %s\n", device->name);
+    event_callback(evt);
+}
+
+static void js_process_hat(struct joystick_device * device, int raw_value, const struct axis_info * info) {
+
+    int value = (raw_value > 0) - (raw_value < 0);
+    int previous = device->hat_value[info->hat_axis];
+
+    if (value == previous) {
+        return;
+    }
+
+    device->hat_value[info->hat_axis] = value;
+
+    // the hat state is tracked even if its events are filtered, in case they are accepted later
+    // (the axes that the kernel drops with the evdev backend are read again in js_apply_event_masks)
+    if (hat_mode == GE_HAT_MODE_NATIVE) {
+        if (!mask_accepts(GE_DEVICE_JOYSTICK, device->id, GE_JOYHATMOTION)) {
+            return;
+        }
+        unsigned int x = info->hat_axis & ~1;
+        GE_Event evt = { .jhat = { .type = GE_JOYHATMOTION, .which = device->id, .hat = info->hat_axis / 2,
+            .value = hat_values[device->hat_value[x] + 1][device->hat_value[x + 1] + 1] } };
+        js_report_event(device, &evt);
+        return;
+    }
+
+    GE_Event evt = { .jbutton = { .which = device->id } };
+    if (previous && mask_accepts(GE_DEVICE_JOYSTICK, device->id, GE_JOYBUTTONUP)) {
+        evt.type = GE_JOYBUTTONUP;
+        evt.jbutton.button = info->buttons[previous + 1];
+        js_report_event(device, &evt);
+    }
+    if (value && mask_accepts(GE_DEVICE_JOYSTICK, device->id, GE_JOYBUTTONDOWN)) {
+        evt.type = GE_JOYBUTTONDOWN;
+        evt.jbutton.button = info->buttons[value + 1];
+        js_report_event(device, &evt);
+    }
+}
+
+static inline void js_process_button(struct joystick_device * device, uint8_t number, int value) {
+
+    if (!mask_accepts(GE_DEVICE_JOYSTICK, device->id, value ? GE_JOYBUTTONDOWN : GE_JOYBUTTONUP)) {
+        return;
+    }
+
+    GE_Event evt = { .jbutton = { .type = value ? GE_JOYBUTTONDOWN : GE_JOYBUTTONUP, .which = device->id,
+        .button = number } };
+    js_report_event(device, &evt);
+}
+
+/*
+ * Process an axis value in the [-32767, 32767] range (or -1, 0, 1 for hat axes).
+ */
+static inline void js_process_axis(struct joystick_device * device, uint8_t number, int value) {
+
+    const struct axis_info * info = device->axes + number;
+    if (info->kind == AXIS_HAT) {
+        js_process_hat(device, value, info);
+    } else if (mask_accepts(GE_DEVICE_JOYSTICK, device->id, GE_JOYAXISMOTION)) {
+        GE_Event evt = { .jaxis = { .type = GE_JOYAXISMOTION, .which = device->id, .axis = number,
+            .value = (value + info->offset) >> info->shift } };
+        js_report_event(device, &evt);
+    }
+}
+
+static void js_process_event(struct joystick_device * device, const struct js_event* je) {
 
     if (je->type & JS_EVENT_INIT) {
         return;
     }
 
+    eprintf("type: %d number: %d value: %d\n", je->type, je->number, je->value);
+
     if (je->type & JS_EVENT_BUTTON) {
-        evt.type = je->value ? GE_JOYBUTTONDOWN : GE_JOYBUTTONUP;
-        evt.jbutton.which = device->id;
-        evt.jbutton.button = je->number;
+        js_process_button(device, je->number, je->value);
     } else if (je->type & JS_EVENT_AXIS) {
-        int axis = device->hat_info.ax_map[je->number];
-        if (axis >= ABS_HAT0X && axis <= ABS_HAT3Y) {
-            // convert hat axes to buttons
-            evt.type = je->value ? GE_JOYBUTTONDOWN : GE_JOYBUTTONUP;
-            int button;
-            int value;
-            axis -= ABS_HAT0X;
-            if (!je->value) {
-                value = device->hat_info.hat_value[axis];
-                device->hat_info.hat_value[axis] = 0;
-            } else {
-                value = je->value / 32767;
-                device->hat_info.hat_value[axis] = value;
-            }
-            button = axis + value + 2 * (axis / 2);
-            if (button < 4 * (axis / 2)) {
-                button += 4;
-            }
-            evt.jbutton.which = device->id;
-            evt.jbutton.button = button + device->hat_info.button_nb;
+        js_process_axis(device, je->number, je->value);
+    }
+}
+
+/*
+ * Process the result of a read: a byte count, or -1 with errno set.
+ * Return -1 if the joystick was closed, in which case it is freed.
+ */
+static int js_process_read(struct joystick_device * device, const void * data, int res) {
+
+    struct joystick_device * previous = reading;
+    reading = device;
+
+    if (res > 0) {
+        const struct js_event * je = data;
+        // js event timestamps are jiffies-based milliseconds, use the read time instead
+        gtime now = gtime_gettime();
+        capture_data(device->capture, now, data, res);
+        timestamp_set(now);
+        unsigned int j;
+        for (j = 0; j < res / sizeof(*je) && !device->closed; ++j) {
+            js_process_event(device, je + j);
+        }
+        dispatch_flush();
+        STATS_READ(device, res / sizeof(*je));
+        STATS_READ_TO_CALLBACK(device, now);
+    } else if (res < 0) {
+        if (errno == EAGAIN) {
+            STATS_EAGAIN(device);
         } else {
-            evt.type = GE_JOYAXISMOTION;
-            evt.jaxis.which = device->id;
-            evt.jaxis.axis = je->number;
-            evt.jaxis.value = je->value;
-            /*
-             * Ugly patch for the sixaxis.
-             */
-            if (device->isSixaxis && evt.jaxis.axis > 3 && evt.jaxis.axis < 23) {
-                evt.jaxis.value = (evt.jaxis.value + 32767) / 2;
-            }
+            js_remove_device(device);
         }
     }
 
-    /*
-     * Process evt.
-     */
-    if (evt.type != GE_NOEVENT) {
-        eprintf("event from joystick: %s\n", device->name);
-        eprintf("type: %d number: %d value: %d\n", je->type, je->number, je->value);
-        event_callback(&evt);
-    }
+    return js_end_read(device, previous);
 }
 
 static int js_process_events(void * user) {
 
     struct joystick_device * device = (struct joystick_device *) user;
 
-    static struct js_event je[MAX_EVENTS];
+    // a short read means the device queue is empty, so that this also works with edge-triggered polling
+    int res;
+    do {
+        res = readbuf_read(&device->buffer, device->fd);
+        if (js_process_read(device, device->buffer.data, res) < 0) {
+            break; // the joystick was closed
+        }
+    } while (res > 0 && res == (int) readbuf_bytes(&device->buffer));
+
+    return 0;
+}
+
+static inline int test_key(const unsigned long * keys, unsigned int code) {
+
+    return (keys[code / LONG_BITS] >> (code % LONG_BITS)) & 1;
+}
+
+static inline void set_key(unsigned long * keys, unsigned int code, int value) {
+
+    if (value) {
+        keys[code / LONG_BITS] |= 1UL << (code % LONG_BITS);
+    } else {
+        keys[code / LONG_BITS] &= ~(1UL << (code % LONG_BITS));
+    }
+}
+
+static inline void js_process_abs(struct joystick_device * device, unsigned int code, int32_t value) {
+
+    struct evdev_map * map = device->evdev;
+    int number = map->abs[code].number;
+    map->abs[code].value = value;
+    if (device->axes[number].kind != AXIS_HAT) {
+        // normalize to the [-32767, 32767] range, as the js interface does
+        if (map->abs[code].scale == 0) {
+            value = 0; // an axis without range stays centered
+        } else {
+            value = ((((int64_t) value - map->abs[code].minimum) * map->abs[code].scale) >> 16) - 32767;
+        }
+        if (value < -32767) {
+            value = -32767;
+        } else if (value > 32767) {
+            value = 32767;
+        }
+    }
+    js_process_axis(device, number, value);
+}
+
+/*
+ * After a SYN_DROPPED, get the current device state, and report the changes.
+ */
+static void js_resync_evdev(struct joystick_device * device) {
+
+    if (device->fd < 0) {
+        return; // the state of a replayed device can't be read
+    }
+
+    struct evdev_map * map = device->evdev;
+
+    unsigned long keys[NLONGS(KEY_CNT)] = { 0 };
+    if (ioctl(device->fd, EVIOCGKEY(sizeof(keys)), keys) < 0) {
+        PRINT_ERROR_ERRNO("ioctl EVIOCGKEY");
+    } else {
+        unsigned int code;
+        for (code = BTN_MISC; code < KEY_CNT; ++code) {
+            int value = test_key(keys, code);
+            if (map->buttons[code - BTN_MISC] >= 0 && test_key(map->keys, code) != value) {
+                set_key(map->keys, code, value);
+                js_process_button(device, map->buttons[code - BTN_MISC], value);
+            }
+        }
+    }
+
+    unsigned int code;
+    for (code = 0; code < ABS_CNT; ++code) {
+        if (map->abs[code].number < 0) {
+            continue;
+        }
+        struct input_absinfo absinfo;
+        if (ioctl(device->fd, EVIOCGABS(code), &absinfo) < 0) {
+            PRINT_ERROR_ERRNO("ioctl EVIOCGABS");
+            continue;
+        }
+        if (absinfo.value != map->abs[code].value) {
+            js_process_abs(device, code, absinfo.value);
+        }
+    }
+}
+
+static void js_process_evdev_event(struct joystick_device * device, const struct input_event* ie) {
+
+    struct evdev_map * map = device->evdev;
+
+    if (map->dropped) {
+        // the events until the next SYN_REPORT are incomplete
+        if (ie->type == EV_SYN && ie->code == SYN_REPORT) {
+            map->dropped = 0;
+            js_resync_evdev(device);
+            dispatch_flush();
+        }
+        return;
+    }
+
+    switch (ie->type) {
+    case EV_SYN:
+        if (ie->code == SYN_REPORT) {
+            // deliver the batched events frame by frame
+            dispatch_flush();
+        } else if (ie->code == SYN_DROPPED) {
+            __atomic_store_n(&device->overflows, device->overflows + 1, __ATOMIC_RELAXED);
+            map->dropped = 1;
+        }
+        break;
+    case EV_KEY:
+        // key repeats (value 2) are ignored
+        if (ie->code >= BTN_MISC && ie->code < KEY_CNT && ie->value <= 1 && map->buttons[ie->code - BTN_MISC] >= 0) {
+            eprintf("type: %d code: %d value: %d\n", ie->type, ie->code, ie->value);
+            set_key(map->keys, ie->code, ie->value);
+            js_process_button(device, map->buttons[ie->code - BTN_MISC], ie->value);
+        }
+        break;
+    case EV_ABS:
+        if (ie->code < ABS_CNT && map->abs[ie->code].number >= 0) {
+            eprintf("type: %d code: %d value: %d\n", ie->type, ie->code, ie->value);
+            js_process_abs(device, ie->code, ie->value);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Process the result of a read: a byte count, or -1 with errno set.
+ * Return -1 if the joystick was closed, in which case it is freed.
+ */
+static int js_process_evdev_read(struct joystick_device * device, const void * data, int res) {
+
+    struct joystick_device * previous = reading;
+    reading = device;
 
-    int res = read(device->fd, je, sizeof(je));
     if (res > 0) {
+        const struct input_event * ie = data;
+        gtime now = (device->monotonic && !STATS_ENABLED && device->capture < 0) ? 0 : gtime_gettime();
+        capture_data(device->capture, now, data, res);
         unsigned int j;
-        for (j = 0; j < res / sizeof(*je); ++j) {
-            js_process_event(device, je + j);
+        for (j = 0; j < res / sizeof(*ie) && !device->closed; ++j) {
+            if (device->monotonic) {
+                timestamp_set(EVENT_TIME(ie + j));
+                STATS_EVENT_TO_READ(device, EVENT_TIME(ie + j), now);
+            } else {
+                timestamp_set(now);
+            }
+            js_process_evdev_event(device, ie + j);
+        }
+        dispatch_flush();
+        STATS_READ(device, res / sizeof(*ie));
+        STATS_READ_TO_CALLBACK(device, now);
+    } else if (res < 0) {
+        if (errno == EAGAIN) {
+            STATS_EAGAIN(device);
+        } else {
+            js_remove_device(device);
         }
-    } else if (res < 0 && errno != EAGAIN) {
-        js_close_internal(device);
     }
 
+    return js_end_read(device, previous);
+}
+
+static int js_process_evdev_events(void * user) {
+
+    struct joystick_device * device = (struct joystick_device *) user;
+
+    // a short read means the device queue is empty, so that this also works with edge-triggered polling
+    int res;
+    do {
+        res = readbuf_read(&device->buffer, device->fd);
+        if (js_process_evdev_read(device, device->buffer.data, res) < 0) {
+            break; // the joystick was closed
+        }
+    } while (res > 0 && res == (int) readbuf_bytes(&device->buffer));
+
     return 0;
 }
 
@@ -200,6 +648,15 @@ static int is_js_device(const struct dirent *dir) {
     return 0;
 }
 
+static int is_event_device(const struct dirent *dir) {
+
+    unsigned int num;
+    if (dir->d_type == DT_CHR && sscanf(dir->d_name, EV_DEV_NAME, &num) == 1 && num < 256) {
+        return 1;
+    }
+    return 0;
+}
+
 static int is_event_dir(const struct dirent *dir) {
 
     unsigned int num;
@@ -260,7 +717,7 @@ static int open_haptic(struct joystick_device * device, int fd_ev) {
         return -1;
     }
     unsigned int i;
-    for (i = 0; i < sizeof(effect_types) / sizeof(*effect_types); ++i) {
+    for (i = 0; i < EFFECT_TYPES; ++i) {
         if (test_bit(effect_types[i].jstype, features)) {
             // Upload the effect.
             struct ff_effect effect = { .type = effect_types[i].jstype, .id = -1 };
@@ -299,12 +756,294 @@ int isSixaxis(const char * name) {
     return 0;
 }
 
+/*
+ * Tell if an event device is a joystick, in a similar way as the joydev kernel module.
+ */
+static int is_joystick(const unsigned long * abs_bits, const unsigned long * key_bits, const unsigned long * props) {
+
+    unsigned int code;
+
+    if (test_bit(INPUT_PROP_ACCELEROMETER, props) || test_bit(BTN_TOUCH, key_bits)) {
+        return 0; // accelerometers, touchpads and tablets
+    }
+
+    for (code = 0; code < ABS_CNT && !test_bit(code, abs_bits); ++code) ;
+    if (code == ABS_CNT) {
+        return 0;
+    }
+
+    for (code = BTN_JOYSTICK; code < BTN_DIGI; ++code) {
+        if (test_bit(code, key_bits)) {
+            return 1;
+        }
+    }
+    for (code = BTN_TRIGGER_HAPPY; code <= BTN_TRIGGER_HAPPY40; ++code) {
+        if (test_bit(code, key_bits)) {
+            return 1;
+        }
+    }
+
+    return test_bit(ABS_X, abs_bits) || test_bit(ABS_WHEEL, abs_bits) || test_bit(ABS_THROTTLE, abs_bits);
+}
+
+/*
+ * Read the capabilities of an event device, and build the axis and button maps.
+ * The axes and the buttons are numbered in the same order as the js interface.
+ * Return NULL if the device is not a joystick.
+ */
+static struct evdev_map * js_read_evdev(int fd, char * name, size_t size, uint8_t ax_map[AXMAP_SIZE],
+        unsigned int * button_nb) {
+
+    unsigned long abs_bits[NLONGS(ABS_CNT)] = { 0 };
+    unsigned long key_bits[NLONGS(KEY_CNT)] = { 0 };
+    unsigned long props[NLONGS(INPUT_PROP_CNT)] = { 0 };
+
+    if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits) < 0
+            || ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits) < 0) {
+        PRINT_ERROR_ERRNO("ioctl EVIOCGBIT");
+        return NULL;
+    }
+    // not supported by old kernels
+    ioctl(fd, EVIOCGPROP(sizeof(props)), props);
+
+    if (!is_joystick(abs_bits, key_bits, props)) {
+        return NULL;
+    }
+
+    if (ioctl(fd, EVIOCGNAME(size - 1), name) < 0) {
+        PRINT_ERROR_ERRNO("ioctl EVIOCGNAME");
+        return NULL;
+    }
+
+    struct evdev_map * map = calloc(1, sizeof(*map));
+    if (map == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        return NULL;
+    }
+
+    unsigned int code;
+    unsigned int number = 0;
+    for (code = 0; code < ABS_CNT; ++code) {
+        map->abs[code].number = -1;
+        if (!test_bit(code, abs_bits)) {
+            continue;
+        }
+        struct input_absinfo absinfo;
+        if (ioctl(fd, EVIOCGABS(code), &absinfo) < 0) {
+            PRINT_ERROR_ERRNO("ioctl EVIOCGABS");
+            continue;
+        }
+        map->abs[code].number = number;
+        map->abs[code].minimum = absinfo.minimum;
+        if (absinfo.maximum > absinfo.minimum) {
+            map->abs[code].scale = (65534LL << 16) / ((int64_t) absinfo.maximum - absinfo.minimum);
+        }
+        map->abs[code].value = absinfo.value;
+        ax_map[number] = code;
+        ++number;
+    }
+
+    // the js interface numbers BTN_JOYSTICK..KEY_MAX first, then BTN_MISC..BTN_JOYSTICK-1
+    for (code = BTN_MISC; code < KEY_CNT; ++code) {
+        map->buttons[code - BTN_MISC] = -1;
+    }
+    number = 0;
+    for (code = BTN_JOYSTICK; code < KEY_CNT + (BTN_JOYSTICK - BTN_MISC) && number < JS_BUTTONS; ++code) {
+        unsigned int key = (code < KEY_CNT) ? code : code - KEY_CNT + BTN_MISC;
+        if (test_bit(key, key_bits)) {
+            map->buttons[key - BTN_MISC] = number++;
+        }
+    }
+    *button_nb = number;
+
+    if (ioctl(fd, EVIOCGKEY(sizeof(map->keys)), map->keys) < 0) {
+        PRINT_ERROR_ERRNO("ioctl EVIOCGKEY");
+    }
+
+    return map;
+}
+
+static GPOLL_REGISTER_FD fp_register = NULL;
+
+static void js_apply_event_masks(struct joystick_device * device);
+
+/*
+ * Record a joystick that was opened, with what is needed to translate its input.
+ * Return its id in the capture, or -1 if no capture is being recorded.
+ */
+static int js_add_capture(const struct joystick_device * device, const uint8_t ax_map[AXMAP_SIZE], unsigned int buttons) {
+
+    if (!capture_enabled()) {
+        return -1;
+    }
+
+    struct js_capture_info info = { .buttons = buttons };
+    memcpy(info.ax_map, ax_map, sizeof(info.ax_map));
+
+    uint8_t data[sizeof(info) + sizeof(*device->evdev)];
+    memcpy(data, &info, sizeof(info));
+    if (device->evdev != NULL) {
+        memcpy(data + sizeof(info), device->evdev, sizeof(*device->evdev));
+    }
+
+    struct capture_device capture = {
+        .source = (device->evdev != NULL) ? CAPTURE_SOURCE_JS_EVDEV : CAPTURE_SOURCE_JS,
+        .name = device->name,
+        .info = data,
+        .info_size = sizeof(info) + ((device->evdev != NULL) ? sizeof(*device->evdev) : 0),
+    };
+
+    return capture_add_device(&capture);
+}
+
+/*
+ * Open a joystick node, with devices_lock held.
+ * The index of the opened joystick is stored in added, for it to be reported once the lock is released.
+ */
+static int js_open_device(const char * node, int * added) {
+
+    unsigned int num;
+    if (sscanf(node, (backend == GE_JOYSTICK_BACKEND_EVDEV) ? EV_DEV_NAME : JS_DEV_NAME, &num) != 1) {
+        return -1;
+    }
+
+    struct joystick_device * current;
+    for (current = GLIST_BEGIN(js_devices); current != GLIST_END(js_devices); current = current->next) {
+        if (current->node == (int) num) {
+            return 0; // already opened
+        }
+    }
+
+    char js_file[strlen(DEV_INPUT) + sizeof('/') + strlen(node) + 1];
+    snprintf(js_file, sizeof(js_file), "%s/%s", DEV_INPUT, node);
+
+    int fd_js;
+    int writable = 0;
+    if (backend == GE_JOYSTICK_BACKEND_EVDEV) {
+        // open the eventX device, with write access for force feedback if allowed
+        fd_js = open(js_file, O_RDWR | O_NONBLOCK);
+        if (fd_js == -1 && errno == EACCES) {
+            fd_js = open(js_file, O_RDONLY | O_NONBLOCK);
+        } else {
+            writable = 1;
+        }
+    } else {
+        // open the jsX device
+        fd_js = open(js_file, O_RDONLY | O_NONBLOCK);
+    }
+    if (fd_js == -1) {
+        // a hotplugged node may not be accessible yet, it will be opened again once its permissions are set
+        if ((!hotplug || errno != EACCES) && GLOG_LEVEL(GLOG_NAME,ERROR)) {
+            fprintf(stderr, "%s:%d %s: opening %s failed with error: %m\n", __FILE__, __LINE__, __func__, js_file);
+        }
+        return -1;
+    }
+
+#define JSOPEN_ERROR() \
+    free(evdev); \
+    close(fd_js); \
+    return -1;
+
+    char name[1024] = { 0 };
+    unsigned int buttons = 0;
+    uint8_t ax_map[AXMAP_SIZE] = {};
+    struct evdev_map * evdev = NULL;
+
+    if (backend == GE_JOYSTICK_BACKEND_EVDEV) {
+        evdev = js_read_evdev(fd_js, name, sizeof(name), ax_map, &buttons);
+        if (evdev == NULL) {
+            JSOPEN_ERROR() // not a joystick
+        }
+    } else {
+        // get the device name
+        if (ioctl(fd_js, JSIOCGNAME(sizeof(name) - 1), name) < 0) {
+            PRINT_ERROR_ERRNO("ioctl EVIOCGNAME");
+            JSOPEN_ERROR()
+        }
+        // get the number of buttons and the axis map, to allow converting hat axes to buttons
+        unsigned char js_buttons;
+        if (ioctl(fd_js, JSIOCGBUTTONS, &js_buttons) < 0) {
+            JSOPEN_ERROR()
+        }
+        buttons = js_buttons;
+        if (ioctl(fd_js, JSIOCGAXMAP, &ax_map) < 0) {
+            JSOPEN_ERROR()
+        }
+    }
+    int index = js_allocate_index(name);
+    if (index < 0) {
+        PRINT_ERROR_OTHER("cannot add other joysticks: max device number reached");
+        JSOPEN_ERROR()
+    }
+    struct joystick_device * device = calloc(1, sizeof(*device));
+    if (device == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        JSOPEN_ERROR()
+    }
+    if (readbuf_init(&device->buffer, (evdev != NULL) ? sizeof(struct input_event) : sizeof(struct js_event)) < 0) {
+        free(device);
+        JSOPEN_ERROR()
+    }
+    js_set_index(device, index);
+    device->name = strdup(name);
+    device->isSixaxis = isSixaxis(name);
+    device->fd = fd_js;
+    device->node = num;
+    device->evdev = evdev;
+    device->force_feedback.fd = -1;
+    device->replay = -1;
+    js_compile_axes(device, ax_map, buttons);
+    device->capture = js_add_capture(device, ax_map, buttons);
+    if (evdev != NULL) {
+        // use the same clock as gtime_gettime() for event timestamps
+        int clock = CLOCK_MONOTONIC;
+        device->monotonic = (ioctl(device->fd, EVIOCSCLOCKID, &clock) == 0);
+        js_apply_event_masks(device);
+        device->hid = get_hid(fd_js);
+        // the event device is also used for force feedback, if it is supported
+        if (writable) {
+            open_haptic(device, fd_js);
+        }
+    }
+    GPOLL_CALLBACKS callbacks = { .fp_read = (evdev != NULL) ? js_process_evdev_events : js_process_events,
+            .fp_write = NULL, .fp_close = js_remove_device };
+    fp_register(device->fd, device, &callbacks);
+    if (evdev == NULL) {
+        int fd_ev = open_evdev(node);
+        if (fd_ev >= 0) {
+            device->hid = get_hid(fd_ev);
+            if (open_haptic(device, fd_ev) == -1) {
+                close(fd_ev); //no need to keep it opened
+            }
+        }
+    }
+    GLIST_ADD(js_devices, device);
+
+    *added = device->id;
+
+    return 0;
+}
+
+static int js_open(const char * node) {
+
+    int added = -1;
+
+    pthread_mutex_lock(&devices_lock);
+    int ret = js_open_device(node, &added);
+    pthread_mutex_unlock(&devices_lock);
+
+    // the event callback may close the joystick, which takes devices_lock
+    if (added >= 0 && hotplug) {
+        js_report_device(GE_JOYDEVICEADDED, added);
+    }
+
+    return ret;
+}
+
 static int js_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(GE_Event*)) {
 
     int ret = 0;
     int i;
-    int fd_js;
-    char name[1024] = { 0 };
 
     struct dirent **namelist_js;
     int n_js;
@@ -325,74 +1064,15 @@ static int js_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(GE_Ev
     }
 
     event_callback = callback;
+    fp_register = poll_interface->fp_register;
     fp_remove = poll_interface->fp_remove;
 
-    // scan /dev/input for jsX devices
-    n_js = scandir(DEV_INPUT, &namelist_js, is_js_device, alphasort);
+    // scan /dev/input for jsX devices (or eventX devices with the evdev backend)
+    n_js = scandir(DEV_INPUT, &namelist_js,
+            (backend == GE_JOYSTICK_BACKEND_EVDEV) ? is_event_device : is_js_device, alphasort);
     if (n_js >= 0) {
         for (i = 0; i < n_js; ++i) {
-#define JSINIT_ERROR() \
-      close(fd_js); \
-      free(namelist_js[i]); \
-      continue;
-
-            if (j_num == sizeof(indexToJoystick) / sizeof(*indexToJoystick)) {
-                PRINT_ERROR_OTHER("cannot add other joysticks: max device number reached");
-                free(namelist_js[i]);
-                continue;
-            }
-
-            char js_file[strlen(DEV_INPUT) + sizeof('/') + strlen(namelist_js[i]->d_name) + 1];
-            snprintf(js_file, sizeof(js_file), "%s/%s", DEV_INPUT, namelist_js[i]->d_name);
-
-            // open the jsX device
-            fd_js = open(js_file, O_RDONLY | O_NONBLOCK);
-            if (fd_js != -1) {
-                // get the device name
-                if (ioctl(fd_js, JSIOCGNAME(sizeof(name) - 1), name) < 0) {
-                    PRINT_ERROR_ERRNO("ioctl EVIOCGNAME");
-                    JSINIT_ERROR()
-                }
-                // get the number of buttons and the axis map, to allow converting hat axes to buttons
-                unsigned char buttons;
-                if (ioctl(fd_js, JSIOCGBUTTONS, &buttons) < 0) {
-                    JSINIT_ERROR()
-                }
-                uint8_t ax_map[AXMAP_SIZE] = {};
-                if (ioctl(fd_js, JSIOCGAXMAP, &ax_map) < 0) {
-                    JSINIT_ERROR()
-                }
-                struct joystick_device * device = calloc(1, sizeof(*device));
-                if (device == NULL) {
-                    PRINT_ERROR_ALLOC_FAILED("calloc");
-                    JSINIT_ERROR()
-                }
-                device->id = j_num;
-                indexToJoystick[j_num] = device;
-                device->name = strdup(name);
-                device->isSixaxis = isSixaxis(name);
-                device->fd = fd_js;
-                device->force_feedback.fd = -1;
-                device->hat_info.button_nb = buttons;
-                memcpy(device->hat_info.ax_map, ax_map, sizeof(device->hat_info.ax_map));
-                GPOLL_CALLBACKS callbacks = { .fp_read = js_process_events, .fp_write = NULL, .fp_close =
-                        js_close_internal };
-                poll_interface->fp_register(device->fd, device, &callbacks);
-                int fd_ev = open_evdev(namelist_js[i]->d_name);
-                if (fd_ev >= 0) {
-                    device->hid = get_hid(fd_ev);
-                    if (open_haptic(device, fd_ev) == -1) {
-                        close(fd_ev); //no need to keep it opened
-                    }
-                }
-                GLIST_ADD(js_devices, device);
-                j_num++;
-            } else {
-                if (GLOG_LEVEL(GLOG_NAME,ERROR)) {
-                    fprintf(stderr, "%s:%d %s: opening %s failed with error: %m\n", __FILE__, __LINE__, __func__, js_file);
-                }
-            }
-
+            js_open(namelist_js[i]->d_name);
             free(namelist_js[i]);
         }
         free(namelist_js);
@@ -406,6 +1086,231 @@ static int js_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(GE_Ev
     return ret;
 }
 
+static int js_init_capture(int (*callback)(GE_Event*)) {
+
+    if (callback == NULL) {
+        PRINT_ERROR_OTHER("callback is NULL");
+        return -1;
+    }
+
+    event_callback = callback;
+
+    return 0;
+}
+
+/*
+ * Create a joystick that gets its input from a capture instead of a device node.
+ */
+static int js_open_capture(int id, const struct capture_device * capture) {
+
+    struct js_capture_info info;
+    size_t size = sizeof(info) + ((capture->source == CAPTURE_SOURCE_JS_EVDEV) ? sizeof(struct evdev_map) : 0);
+    if ((capture->source != CAPTURE_SOURCE_JS && capture->source != CAPTURE_SOURCE_JS_EVDEV)
+            || capture->info_size != size) {
+        PRINT_ERROR_OTHER("not a joystick capture");
+        return -1;
+    }
+
+    memcpy(&info, capture->info, sizeof(info));
+
+    struct evdev_map * evdev = NULL;
+    if (capture->source == CAPTURE_SOURCE_JS_EVDEV) {
+        evdev = malloc(sizeof(*evdev));
+        if (evdev == NULL) {
+            PRINT_ERROR_ALLOC_FAILED("malloc");
+            return -1;
+        }
+        memcpy(evdev, (const uint8_t *) capture->info + sizeof(info), sizeof(*evdev));
+    }
+
+    struct joystick_device * device = calloc(1, sizeof(*device));
+    if (device == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        free(evdev);
+        return -1;
+    }
+
+    pthread_mutex_lock(&devices_lock);
+
+    int index = js_allocate_index(capture->name);
+    if (index < 0) {
+        pthread_mutex_unlock(&devices_lock);
+        PRINT_ERROR_OTHER("cannot add other joysticks: max device number reached");
+        free(device);
+        free(evdev);
+        return -1;
+    }
+
+    js_set_index(device, index);
+    device->name = strdup(capture->name);
+    device->isSixaxis = isSixaxis(capture->name);
+    device->fd = -1;
+    device->node = -1;
+    device->evdev = evdev;
+    device->force_feedback.fd = -1;
+    device->capture = -1;
+    device->replay = id;
+    js_compile_axes(device, info.ax_map, info.buttons);
+    GLIST_ADD(js_devices, device);
+
+    pthread_mutex_unlock(&devices_lock);
+
+    if (hotplug) {
+        js_report_device(GE_JOYDEVICEADDED, index);
+    }
+
+    return 0;
+}
+
+/*
+ * The list is walked with devices_lock held, as the reader threads may close other joysticks meanwhile.
+ * Replayed joysticks are closed by the replay itself, or with the sources locked, so that they outlive the lookup.
+ */
+static struct joystick_device * js_get_replayed(int id) {
+
+    pthread_mutex_lock(&devices_lock);
+
+    struct joystick_device * device;
+    for (device = GLIST_BEGIN(js_devices); device != GLIST_END(js_devices); device = device->next) {
+        if (device->replay == id) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&devices_lock);
+
+    return (device != GLIST_END(js_devices)) ? device : NULL;
+}
+
+static void js_process_capture(int id, const void * data, unsigned int size) {
+
+    struct joystick_device * device = js_get_replayed(id);
+    if (device == NULL) {
+        return;
+    }
+
+    if (device->evdev != NULL) {
+        js_process_evdev_read(device, data, size);
+    } else {
+        js_process_read(device, data, size);
+    }
+}
+
+static void js_close_capture(int id) {
+
+    struct joystick_device * device = js_get_replayed(id);
+    if (device != NULL) {
+        js_remove_device(device);
+    }
+}
+
+static void js_update_event_masks();
+
+static void js_set_hat_mode(GE_HatMode mode) {
+
+    if (hat_mode == mode) {
+        return;
+    }
+    hat_mode = mode;
+    // the hat axes are filtered by the kernel according to the hat mode
+    js_update_event_masks();
+}
+
+static int js_set_backend(GE_JoystickBackend value) {
+
+    if (value != GE_JOYSTICK_BACKEND_JS && value != GE_JOYSTICK_BACKEND_EVDEV) {
+        PRINT_ERROR_OTHER("invalid joystick backend");
+        return -1;
+    }
+    backend = value;
+    return 0;
+}
+
+/*
+ * With the evdev backend, ask the kernel to drop the button and axis events that are filtered,
+ * so that they don't even wake the reading thread up.
+ * The hat axes that are no longer masked get their current value back.
+ */
+static void js_apply_event_masks(struct joystick_device * device) {
+#ifdef EVIOCSMASK
+    struct evdev_map * map = device->evdev;
+    if (map == NULL || device->fd < 0) {
+        return; // replayed devices are filtered in js_process_evdev_event
+    }
+
+    uint32_t mask = mask_get(GE_DEVICE_JOYSTICK, device->id);
+    uint32_t button_types = GE_EVENT_MASK(GE_JOYBUTTONDOWN) | GE_EVENT_MASK(GE_JOYBUTTONUP);
+    uint32_t hat_types = (hat_mode == GE_HAT_MODE_NATIVE) ? GE_EVENT_MASK(GE_JOYHATMOTION) : button_types;
+
+    unsigned long keys[NLONGS(KEY_CNT)] = { 0 };
+    unsigned long abs[NLONGS(ABS_CNT)] = { 0 };
+
+    unsigned int code;
+    if (mask & button_types) {
+        for (code = BTN_MISC; code < KEY_CNT; ++code) {
+            set_key(keys, code, map->buttons[code - BTN_MISC] >= 0);
+        }
+    }
+    for (code = 0; code < ABS_CNT; ++code) {
+        int number = map->abs[code].number;
+        if (number >= 0) {
+            uint32_t types = (device->axes[number].kind == AXIS_HAT) ? hat_types : GE_EVENT_MASK(GE_JOYAXISMOTION);
+            set_key(abs, code, (mask & types) != 0);
+        }
+    }
+
+    struct input_mask masks[] = {
+        { .type = EV_KEY, .codes_size = sizeof(keys), .codes_ptr = (uintptr_t) keys },
+        { .type = EV_ABS, .codes_size = sizeof(abs), .codes_ptr = (uintptr_t) abs },
+    };
+    int applied[sizeof(masks) / sizeof(*masks)];
+    unsigned int i;
+    for (i = 0; i < sizeof(masks) / sizeof(*masks); ++i) {
+        // older kernels don't support EVIOCSMASK, the events are then filtered in js_process_evdev_event
+        applied[i] = (ioctl(device->fd, EVIOCSMASK, masks + i) == 0);
+        if (!applied[i] && errno != EINVAL && errno != ENOTTY) {
+            PRINT_ERROR_ERRNO("ioctl EVIOCSMASK");
+        }
+    }
+    if (!applied[1]) {
+        return; // the kernel still reports all the axes
+    }
+
+    for (code = 0; code < ABS_CNT; ++code) {
+        int number = map->abs[code].number;
+        if (number < 0) {
+            continue;
+        }
+        if (device->axes[number].kind == AXIS_HAT && test_key(map->abs_masked, code) && test_key(abs, code)) {
+            // the hat axis was not tracked while it was masked: start again from its current value
+            struct input_absinfo absinfo;
+            if (ioctl(device->fd, EVIOCGABS(code), &absinfo) < 0) {
+                PRINT_ERROR_ERRNO("ioctl EVIOCGABS");
+            } else {
+                map->abs[code].value = absinfo.value;
+                device->hat_value[device->axes[number].hat_axis] = (absinfo.value > 0) - (absinfo.value < 0);
+            }
+        }
+        set_key(map->abs_masked, code, !test_key(abs, code));
+    }
+#else
+    (void) device;
+#endif
+}
+
+static void js_update_event_masks() {
+
+    struct joystick_device * device;
+    for (device = GLIST_BEGIN(js_devices); device != GLIST_END(js_devices); device = device->next) {
+        js_apply_event_masks(device);
+    }
+}
+
+static void js_set_hotplug(int enable) {
+
+    hotplug = enable;
+}
+
 static int js_get_haptic(int joystick) {
 
     CHECK_DEVICE(joystick, -1)
@@ -413,6 +1318,67 @@ static int js_get_haptic(int joystick) {
     return indexToJoystick[joystick]->force_feedback.effects;
 }
 
+static int is_active(const struct ff_effect * effect) {
+
+    switch (effect->type) {
+    case FF_RUMBLE:
+        return effect->u.rumble.strong_magnitude || effect->u.rumble.weak_magnitude;
+    case FF_CONSTANT:
+        return effect->u.constant.level != 0;
+    case FF_SPRING:
+    case FF_DAMPER:
+        return effect->u.condition[0].right_coeff || effect->u.condition[0].left_coeff;
+    case FF_PERIODIC:
+        return effect->u.periodic.magnitude || effect->u.periodic.offset;
+    }
+    return 1;
+}
+
+/*
+ * Upload the pending effect if it changed, and play or stop it if it got active or inactive.
+ */
+static int js_flush_effect(struct joystick_device * device, int i) {
+
+    struct effect_state * state = device->force_feedback.states + i;
+
+    if (!state->has_pending) {
+        return 0;
+    }
+
+    state->has_pending = 0;
+    state->last_update = gtime_gettime();
+
+    int ret = 0;
+    int fd = device->force_feedback.fd;
+    int active = is_active(&state->pending);
+
+    if (active && (!state->valid || memcmp(&state->uploaded, &state->pending, sizeof(state->uploaded)))) {
+        // Update the effect.
+        if (ioctl(fd, EVIOCSFF, &state->pending) == -1) {
+            PRINT_ERROR_ERRNO("ioctl EVIOCSFF");
+            state->valid = 0;
+            ret = -1;
+        } else {
+            memcpy(&state->uploaded, &state->pending, sizeof(state->uploaded));
+            state->valid = 1;
+        }
+    }
+
+    if (active != state->playing) {
+        struct input_event play = { .type = EV_FF, .value = active, /* play: 1, stop: 0 */
+        .code = state->pending.id };
+        // Play or stop the effect.
+        if (write(fd, (const void*) &play, sizeof(play)) == -1) {
+            PRINT_ERROR_ERRNO("write");
+            ret = -1;
+        } else {
+            state->playing = active;
+        }
+    }
+
+    return ret;
+}
+
 static int js_set_haptic(const GE_Event * event) {
 
     int joystick = event->which;
@@ -426,12 +1392,18 @@ static int js_set_haptic(const GE_Event * event) {
     int fd = device->force_feedback.fd;
 
     if (fd >= 0) {
-        struct ff_effect effect = { .id = -1, .direction = 0x4000 /* positive means left */};
+        // clear the padding as well, as effects are compared using memcmp
+        struct ff_effect effect;
+        memset(&effect, 0x00, sizeof(effect));
+        effect.id = -1;
+        effect.direction = 0x4000; // positive means left
+        GE_HapticType type = GE_HAPTIC_NONE;
         unsigned int effects = device->force_feedback.effects;
         switch (event->type) {
         case GE_JOYRUMBLE:
             if (effects & GE_HAPTIC_RUMBLE) {
-                effect.id = get_effect_id(device, GE_HAPTIC_RUMBLE);
+                type = GE_HAPTIC_RUMBLE;
+                effect.id = get_effect_id(device, type);
                 effect.type = FF_RUMBLE;
                 effect.u.rumble.strong_magnitude = event->jrumble.strong;
                 effect.u.rumble.weak_magnitude = event->jrumble.weak;
@@ -439,14 +1411,16 @@ static int js_set_haptic(const GE_Event * event) {
             break;
         case GE_JOYCONSTANTFORCE:
             if (effects & GE_HAPTIC_CONSTANT) {
-                effect.id = get_effect_id(device, GE_HAPTIC_CONSTANT);
+                type = GE_HAPTIC_CONSTANT;
+                effect.id = get_effect_id(device, type);
                 effect.type = FF_CONSTANT;
                 effect.u.constant.level = event->jconstant.level;
             }
             break;
         case GE_JOYSPRINGFORCE:
             if (effects & GE_HAPTIC_SPRING) {
-                effect.id = get_effect_id(device, GE_HAPTIC_SPRING);
+                type = GE_HAPTIC_SPRING;
+                effect.id = get_effect_id(device, type);
                 effect.type = FF_SPRING;
                 effect.u.condition[0].right_saturation = event->jcondition.saturation.right;
                 effect.u.condition[0].left_saturation = event->jcondition.saturation.left;
@@ -458,7 +1432,8 @@ static int js_set_haptic(const GE_Event * event) {
             break;
         case GE_JOYDAMPERFORCE:
             if (effects & GE_HAPTIC_DAMPER) {
-                effect.id = get_effect_id(device, GE_HAPTIC_DAMPER);
+                type = GE_HAPTIC_DAMPER;
+                effect.id = get_effect_id(device, type);
                 effect.type = FF_DAMPER;
                 effect.u.condition[0].right_saturation = event->jcondition.saturation.right;
                 effect.u.condition[0].left_saturation = event->jcondition.saturation.left;
@@ -470,7 +1445,8 @@ static int js_set_haptic(const GE_Event * event) {
             break;
         case GE_JOYSINEFORCE:
             if (effects & GE_HAPTIC_SINE) {
-                effect.id = get_effect_id(device, GE_HAPTIC_SINE);
+                type = GE_HAPTIC_SINE;
+                effect.id = get_effect_id(device, type);
                 effect.type = FF_PERIODIC;
                 effect.u.periodic.waveform = FF_SINE;
                 effect.u.periodic.magnitude = event->jperiodic.sine.magnitude;
@@ -482,17 +1458,13 @@ static int js_set_haptic(const GE_Event * event) {
             break;
         }
         if (effect.id != -1) {
-            // Update the effect.
-            if (ioctl(fd, EVIOCSFF, &effect) == -1) {
-                PRINT_ERROR_ERRNO("ioctl EVIOCSFF");
-                ret = -1;
-            }
-            struct input_event play = { .type = EV_FF, .value = 1, /* play: 1, stop: 0 */
-            .code = effect.id };
-            // Play the effect.
-            if (write(fd, (const void*) &play, sizeof(play)) == -1) {
-                PRINT_ERROR_ERRNO("write");
-                ret = -1;
+            int i = get_effect_index(type);
+            struct effect_state * state = device->force_feedback.states + i;
+            memcpy(&state->pending, &effect, sizeof(state->pending));
+            state->has_pending = 1;
+            // updates that come too fast are coalesced, and flushed by js_sync_process
+            if (haptic_period == 0 || gtime_gettime() - state->last_update >= haptic_period) {
+                ret = js_flush_effect(device, i);
             }
         }
     } else if (device->force_feedback.haptic_cb) {
@@ -504,6 +1476,39 @@ static int js_set_haptic(const GE_Event * event) {
     return ret;
 }
 
+static void js_set_haptic_rate(unsigned int rate) {
+
+    haptic_period = rate ? 1000000000LL / rate : 0;
+}
+
+/*
+ * Flush the effect updates that were deferred by the rate limit.
+ */
+static int js_sync_process() {
+
+    if (haptic_period == 0) {
+        return 0;
+    }
+
+    gtime now = gtime_gettime();
+
+    struct joystick_device * device;
+    for (device = GLIST_BEGIN(js_devices); device != GLIST_END(js_devices); device = device->next) {
+        if (device->force_feedback.fd < 0) {
+            continue;
+        }
+        unsigned int i;
+        for (i = 0; i < EFFECT_TYPES; ++i) {
+            struct effect_state * state = device->force_feedback.states + i;
+            if (state->has_pending && now - state->last_update >= haptic_period) {
+                js_flush_effect(device, i);
+            }
+        }
+    }
+
+    return 0;
+}
+
 static void * js_get_hid(int joystick) {
 
     CHECK_DEVICE(joystick, NULL)
@@ -511,25 +1516,76 @@ static void * js_get_hid(int joystick) {
     return indexToJoystick[joystick]->hid;
 }
 
+/*
+ * Get a joystick that is read by this source, with devices_lock held.
+ * The statistics and the overflow counts can be read from any thread, while joysticks are closed.
+ */
+static struct joystick_device * js_lock_read_device(int joystick) {
+
+    pthread_mutex_lock(&devices_lock);
+
+    if (joystick < 0 || joystick >= j_num || indexToJoystick[joystick] == NULL || indexToJoystick[joystick]->fd < 0) {
+        return NULL;
+    }
+
+    return indexToJoystick[joystick];
+}
+
+static int js_get_stats(int joystick, GE_Stats * stats) {
+
+    int ret = -1;
+    struct joystick_device * device = js_lock_read_device(joystick);
+    if (device != NULL) {
+        ret = STATS_GET(device, stats);
+    }
+    pthread_mutex_unlock(&devices_lock);
+    return ret;
+}
+
+static int js_get_overflows(int joystick, uint64_t * overflows) {
+
+    int ret = -1;
+    struct joystick_device * device = js_lock_read_device(joystick);
+    if (device != NULL) {
+        // the js interface does not report overflows
+        *overflows = __atomic_load_n(&device->overflows, __ATOMIC_RELAXED);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&devices_lock);
+    return ret;
+}
+
 static int js_close_internal(void * user) {
 
     struct joystick_device * device = (struct joystick_device *) user;
 
-    free(device->name);
+    pthread_mutex_lock(&devices_lock);
+
+    free(previous_names[device->id]);
+    previous_names[device->id] = device->name;
 
     if (device->fd >= 0) {
         fp_remove(device->fd);
         close(device->fd);
     }
-    if (device->force_feedback.fd >= 0) {
+    if (device->force_feedback.fd >= 0 && device->force_feedback.fd != device->fd) {
         close(device->force_feedback.fd);
     }
+    device->fd = -1;
+    device->force_feedback.fd = -1;
+    capture_remove_device(device->capture);
 
     indexToJoystick[device->id] = NULL;
 
     GLIST_REMOVE(js_devices, device);
 
-    free(device);
+    pthread_mutex_unlock(&devices_lock);
+
+    if (device == reading) {
+        device->closed = 1; // freed once its input is processed
+    } else {
+        js_free_device(device);
+    }
 
     return 0;
 }
@@ -541,11 +1597,26 @@ static int js_close(int joystick) {
     return js_close_internal(indexToJoystick[joystick]);
 }
 
+static int js_remove(int joystick) {
+
+    CHECK_DEVICE(joystick, -1)
+
+    return js_remove_device(indexToJoystick[joystick]);
+}
+
 static void js_quit() {
 
     GLIST_CLEAN_ALL(js_devices, js_close_internal)
 
     j_num = 0;
+
+    int i;
+    for (i = 0; i < GE_MAX_DEVICES; ++i) {
+        free(previous_names[i]);
+        previous_names[i] = NULL;
+    }
+
+    hotplug = 0;
 }
 
 static const char* js_get_name(int joystick) {
@@ -557,22 +1628,26 @@ static const char* js_get_name(int joystick) {
 
 static int js_add(const char * name, unsigned int effects, int (*haptic_cb)(const GE_Event * event)) {
 
-    int index = -1;
-    if (j_num < GE_MAX_DEVICES) {
+    int index = js_allocate_index(name);
+    if (index >= 0) {
         struct joystick_device * device = calloc(1, sizeof(*device));
         if (device != NULL) {
-            index = j_num;
-            indexToJoystick[j_num] = device;
-            device->id = index;
+            js_set_index(device, index);
             device->fd = -1;
+            device->node = -1;
+            device->capture = -1;
+            device->replay = -1;
             device->name = strdup(name);
             device->force_feedback.fd = -1;
             device->force_feedback.effects = effects;
             device->force_feedback.haptic_cb = haptic_cb;
             GLIST_ADD(js_devices, device);
-            ++j_num;
+            if (hotplug) {
+                js_report_device(GE_JOYDEVICEADDED, index);
+            }
         } else {
             PRINT_ERROR_ALLOC_FAILED("calloc");
+            index = -1;
         }
     }
     return index;
@@ -585,8 +1660,21 @@ static struct js_source source = {
     .get_haptic = js_get_haptic,
     .set_haptic = js_set_haptic,
     .get_hid = js_get_hid,
+    .get_stats = js_get_stats,
+    .get_overflows = js_get_overflows,
     .close = js_close,
-    .sync_process = NULL,
+    .remove = js_remove,
+    .set_hat_mode = js_set_hat_mode,
+    .set_haptic_rate = js_set_haptic_rate,
+    .set_backend = js_set_backend,
+    .set_hotplug = js_set_hotplug,
+    .update_event_masks = js_update_event_masks,
+    .open = js_open,
+    .init_capture = js_init_capture,
+    .open_capture = js_open_capture,
+    .process_capture = js_process_capture,
+    .close_capture = js_close_capture,
+    .sync_process = js_sync_process,
     .quit = js_quit,
 };
 
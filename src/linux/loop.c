@@ -0,0 +1,383 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#include <ginput.h>
+#include <gimxcommon/include/gerror.h>
+#include <gimxcommon/include/glist.h>
+
+#include "../loop.h"
+
+/*
+ * The internal event loop, used when ginput_init is given no poll interface.
+ *
+ * Each registered fd carries its callbacks as epoll user data, so that a wakeup
+ * directly calls the right handler. Sources that read their fd until it is drained
+ * are registered through the edge-triggered interface.
+ *
+ * The loop can be split into shards, each with its own epoll instance, that are
+ * dispatched by different reader threads. New fds go to the shard with the fewest
+ * sources, so that devices are spread across the shards.
+ *
+ * Sources can be removed from within a callback (e.g. when a device is unplugged),
+ * or by another thread while epoll_wait is returning, so that some of their events
+ * may still be pending in the current epoll_wait batch. Removed sources are only freed
+ * at the end of the next batch of their shard.
+ *
+ * The callbacks of the different shards run concurrently, with the loop lock held for reading.
+ * Whatever may touch the devices of another shard runs with the lock held for writing:
+ * the calls from the application thread (see loop_lock), the exclusive sources
+ * (e.g. hotplug), and the close callbacks.
+ */
+
+#define LOOP_MAX_EVENTS 64
+
+struct loop_source {
+    int fd;
+    void * user;
+    GPOLL_CALLBACKS callbacks;
+    int exclusive;
+    unsigned int shard;
+    GLIST_LINK(struct loop_source);
+};
+
+static struct loop_shard {
+    int epfd;
+    unsigned int count; // the number of sources
+    struct loop_source sources; // list head
+    struct loop_source removed; // list head
+} shards[LOOP_MAX_SHARDS] = { [0 ... LOOP_MAX_SHARDS - 1] = { .epfd = -1 } };
+
+static unsigned int nb_shards = 0;
+
+// writers are preferred, so that the application thread is not starved by busy shards
+static pthread_rwlock_t lock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+
+// protects the source lists, that may be updated by several shards at once
+static pthread_mutex_t lists_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * How many times the current thread holds the lock for writing.
+ * The event callback may call the library (e.g. ginput_grab_toggle) while the loop
+ * holds the lock for writing, in which case the lock is not taken again.
+ */
+static __thread unsigned int write_depth = 0;
+
+void loop_lock() {
+
+    if (write_depth++ == 0) {
+        pthread_rwlock_wrlock(&lock);
+    }
+}
+
+void loop_unlock() {
+
+    if (--write_depth == 0) {
+        pthread_rwlock_unlock(&lock);
+    }
+}
+
+static void loop_free_removed(struct loop_shard * shard) {
+
+    pthread_mutex_lock(&lists_lock);
+    while (GLIST_BEGIN(shard->removed) != GLIST_END(shard->removed)) {
+        struct loop_source * source = GLIST_BEGIN(shard->removed);
+        GLIST_REMOVE(shard->removed, source);
+        free(source);
+    }
+    pthread_mutex_unlock(&lists_lock);
+}
+
+static int loop_add(unsigned int index, int fd, void * user, const GPOLL_CALLBACKS * callbacks, uint32_t flags, int exclusive) {
+
+    struct loop_shard * shard = shards + index;
+
+    if (shard->epfd < 0) {
+        PRINT_ERROR_OTHER("the event loop is not initialized");
+        return -1;
+    }
+
+    if (callbacks->fp_read == NULL && callbacks->fp_write == NULL) {
+        PRINT_ERROR_OTHER("fp_read and fp_write are NULL");
+        return -1;
+    }
+
+    struct loop_source * source = calloc(1, sizeof(*source));
+    if (source == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        return -1;
+    }
+
+    source->fd = fd;
+    source->user = user;
+    source->callbacks = *callbacks;
+    source->exclusive = exclusive;
+    source->shard = index;
+
+    struct epoll_event event = { .events = flags, .data = { .ptr = source } };
+    if (callbacks->fp_read != NULL) {
+        event.events |= EPOLLIN;
+    }
+    if (callbacks->fp_write != NULL) {
+        event.events |= EPOLLOUT;
+    }
+
+    pthread_mutex_lock(&lists_lock);
+
+    if (epoll_ctl(shard->epfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        pthread_mutex_unlock(&lists_lock);
+        PRINT_ERROR_ERRNO("epoll_ctl EPOLL_CTL_ADD");
+        free(source);
+        return -1;
+    }
+
+    GLIST_ADD(shard->sources, source);
+    ++shard->count;
+
+    pthread_mutex_unlock(&lists_lock);
+
+    return 0;
+}
+
+/*
+ * Get the shard with the fewest sources.
+ */
+static unsigned int loop_pick_shard() {
+
+    unsigned int best = 0;
+    unsigned int i;
+    for (i = 1; i < nb_shards; ++i) {
+        if (shards[i].count < shards[best].count) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int loop_register_shard(unsigned int shard, int fd, void * user, const GPOLL_CALLBACKS * callbacks) {
+
+    if (shard >= nb_shards) {
+        PRINT_ERROR_OTHER("invalid shard");
+        return -1;
+    }
+
+    return loop_add(shard, fd, user, callbacks, 0, 0);
+}
+
+static int loop_register_level(int fd, void * user, const GPOLL_CALLBACKS * callbacks) {
+
+    return loop_add(loop_pick_shard(), fd, user, callbacks, 0, 0);
+}
+
+static int loop_register_edge(int fd, void * user, const GPOLL_CALLBACKS * callbacks) {
+
+    return loop_add(loop_pick_shard(), fd, user, callbacks, EPOLLET, 0);
+}
+
+static int loop_register_exclusive(int fd, void * user, const GPOLL_CALLBACKS * callbacks) {
+
+    return loop_add(loop_pick_shard(), fd, user, callbacks, EPOLLET, 1);
+}
+
+static int loop_remove(int fd) {
+
+    pthread_mutex_lock(&lists_lock);
+
+    struct loop_source * source = NULL;
+    unsigned int i;
+    for (i = 0; i < nb_shards && source == NULL; ++i) {
+        struct loop_source * current;
+        for (current = GLIST_BEGIN(shards[i].sources); current != GLIST_END(shards[i].sources); current = current->next) {
+            if (current->fd == fd) {
+                source = current;
+                break;
+            }
+        }
+    }
+
+    if (source == NULL) {
+        pthread_mutex_unlock(&lists_lock);
+        return -1;
+    }
+
+    struct loop_shard * shard = shards + source->shard;
+
+    // the fd may already be closed, in which case it was already removed from the epoll set
+    epoll_ctl(shard->epfd, EPOLL_CTL_DEL, fd, NULL);
+
+    GLIST_REMOVE(shard->sources, source);
+    --shard->count;
+    source->fd = -1;
+    GLIST_ADD(shard->removed, source);
+
+    pthread_mutex_unlock(&lists_lock);
+
+    return 0;
+}
+
+const GPOLL_INTERFACE loop_interface = {
+    .fp_register = loop_register_level,
+    .fp_remove = loop_remove,
+};
+
+const GPOLL_INTERFACE loop_interface_edge = {
+    .fp_register = loop_register_edge,
+    .fp_remove = loop_remove,
+};
+
+const GPOLL_INTERFACE loop_interface_exclusive = {
+    .fp_register = loop_register_exclusive,
+    .fp_remove = loop_remove,
+};
+
+int loop_init(unsigned int count) {
+
+    if (nb_shards > 0) {
+        return 0;
+    }
+
+    if (count == 0 || count > LOOP_MAX_SHARDS) {
+        PRINT_ERROR_OTHER("invalid shard count");
+        return -1;
+    }
+
+    unsigned int i;
+    for (i = 0; i < count; ++i) {
+        shards[i].sources.prev = shards[i].sources.next = &shards[i].sources;
+        shards[i].removed.prev = shards[i].removed.next = &shards[i].removed;
+        shards[i].count = 0;
+        shards[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (shards[i].epfd < 0) {
+            PRINT_ERROR_ERRNO("epoll_create1");
+            while (i > 0) {
+                --i;
+                close(shards[i].epfd);
+                shards[i].epfd = -1;
+            }
+            return -1;
+        }
+    }
+
+    nb_shards = count;
+
+    return 0;
+}
+
+unsigned int loop_get_shards() {
+
+    return nb_shards;
+}
+
+int loop_get_fd() {
+
+    return shards[0].epfd;
+}
+
+/*
+ * Run a callback that may touch the devices of other shards, with the lock held for writing.
+ * The lock is held for reading when this is called.
+ */
+#define LOOP_EXCLUSIVE(EXCLUSIVE, STATEMENT) \
+    do { \
+        if ((EXCLUSIVE) && nb_shards > 1) { \
+            pthread_rwlock_unlock(&lock); \
+            loop_lock(); \
+            STATEMENT; \
+            loop_unlock(); \
+            pthread_rwlock_rdlock(&lock); \
+        } else { \
+            STATEMENT; \
+        } \
+    } while (0)
+
+int loop_dispatch_shard(unsigned int index, int timeout) {
+
+    if (index >= nb_shards) {
+        PRINT_ERROR_OTHER("the event loop is not initialized");
+        return -1;
+    }
+
+    struct loop_shard * shard = shards + index;
+
+    struct epoll_event events[LOOP_MAX_EVENTS];
+
+    int nfds = epoll_wait(shard->epfd, events, LOOP_MAX_EVENTS, timeout);
+    if (nfds < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        PRINT_ERROR_ERRNO("epoll_wait");
+        return -1;
+    }
+
+    // a single shard keeps the lock exclusive, as the callbacks don't have to be serialized otherwise
+    int shared = (nb_shards > 1);
+    if (shared) {
+        pthread_rwlock_rdlock(&lock);
+    } else {
+        loop_lock();
+    }
+
+    int i;
+    for (i = 0; i < nfds; ++i) {
+        struct loop_source * source = events[i].data.ptr;
+        int closed = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+        LOOP_EXCLUSIVE(source->exclusive || closed, {
+            if (source->fd >= 0 && (events[i].events & EPOLLIN)) {
+                source->callbacks.fp_read(source->user);
+            }
+            if (source->fd >= 0 && (events[i].events & EPOLLOUT)) {
+                source->callbacks.fp_write(source->user);
+            }
+            if (source->fd >= 0 && closed && !(events[i].events & EPOLLIN)) {
+                if (source->callbacks.fp_close != NULL) {
+                    source->callbacks.fp_close(source->user);
+                }
+                // a source that is not removed by its close callback would wake the loop up forever
+                if (source->fd >= 0) {
+                    loop_remove(source->fd);
+                }
+            }
+        });
+    }
+
+    loop_free_removed(shard);
+
+    if (shared) {
+        pthread_rwlock_unlock(&lock);
+    } else {
+        loop_unlock();
+    }
+
+    return nfds;
+}
+
+int loop_dispatch(int timeout) {
+
+    return loop_dispatch_shard(0, timeout);
+}
+
+void loop_quit() {
+
+    unsigned int i;
+    for (i = 0; i < nb_shards; ++i) {
+        while (GLIST_BEGIN(shards[i].sources) != GLIST_END(shards[i].sources)) {
+            loop_remove(GLIST_BEGIN(shards[i].sources)->fd);
+        }
+        loop_free_removed(shards + i);
+
+        close(shards[i].epfd);
+        shards[i].epfd = -1;
+    }
+
+    nb_shards = 0;
+}
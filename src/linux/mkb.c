@@ -12,12 +12,20 @@
 #include <string.h>
 #include <stdlib.h>
 #include <dirent.h>
+#include <time.h>
+#include <pthread.h>
 #include <ginput.h>
 #include <gimxpoll/include/gpoll.h>
 #include <gimxcommon/include/gerror.h>
 #include <gimxcommon/include/glist.h>
 #include <gimxlog/include/glog.h>
 #include "../events.h"
+#include "../timestamp.h"
+#include "../dispatch.h"
+#include "../stats.h"
+#include "../mask.h"
+#include "../capture.h"
+#include "readbuf.h"
 
 #define eprintf(...) if(debug) printf(__VA_ARGS__)
 
@@ -31,26 +39,96 @@ static int debug = 0;
 #define DEVTYPE_MOUSE    0x02
 #define DEVTYPE_NB       2
 
+#ifndef input_event_sec
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+#define EVENT_TIME(IE) ((gtime) (IE)->input_event_sec * 1000000000ULL + (gtime) (IE)->input_event_usec * 1000ULL)
+
+#define LONG_BITS (sizeof(long) * 8)
+#define NLONGS(x) (((x) + LONG_BITS - 1) / LONG_BITS)
+
 static GPOLL_REMOVE_SOURCE fp_remove = NULL;
 
 struct mkb_device
 {
   int fd;
+  int node; // the X in /dev/input/eventX
   int mouse;
   int keyboard;
   char* name;
+  int monotonic; // 1 if event timestamps use CLOCK_MONOTONIC
+  struct {
+    int xrel;
+    int yrel;
+    int pending;
+  } motion; // relative motion accumulated until the end of the frame (or of the read)
+  unsigned long keys[NLONGS(KEY_CNT)]; // the key and button states, to resync after a SYN_DROPPED
+  int dropped; // 1 if the events are dropped until the next SYN_REPORT
+  uint64_t overflows; // the number of SYN_DROPPED, written by the reading thread only
+  struct readbuf buffer;
+  int capture; // the id of the device in the capture that is recorded, or -1
+  int replay; // the id of the device in the capture that is replayed, or -1 if it is a real device
+  int closed; // 1 if the device was closed while its input was processed, see reading
+  STATS_FIELD
   GLIST_LINK(struct mkb_device);
 };
 
+static GE_MotionMode motion_mode = GE_MOTION_FRAME;
+
 static int k_num;
 static int m_num;
 
+// the names of the removed keyboards and mice, to reuse their index
+static char * previous_names[DEVTYPE_NB][GE_MAX_DEVICES] = { };
+
+#define PREVIOUS_NAMES(DEVTYPE) previous_names[(DEVTYPE) - 1]
+
+// the opened keyboards and mice, by index
+static struct mkb_device * index_to_device[DEVTYPE_NB][GE_MAX_DEVICES] = { };
+
+#define INDEX_TO_DEVICE(DEVTYPE) index_to_device[(DEVTYPE) - 1]
+
 static int grab = 0;
 
+static int hotplug = 0;
+
+/*
+ * With several reader threads, devices of different threads may be removed at the same time.
+ */
+static pthread_mutex_t devices_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void mkb_set_previous_name(unsigned char devtype, int index, const char * name) {
+
+    if (index >= 0) {
+        free(PREVIOUS_NAMES(devtype)[index]);
+        PREVIOUS_NAMES(devtype)[index] = strdup(name);
+        INDEX_TO_DEVICE(devtype)[index] = NULL;
+    }
+}
+
+/*
+ * The device whose input is processed by the current thread.
+ * The event callback may close it, it is then only freed once its input is processed.
+ */
+static __thread struct mkb_device * reading = NULL;
+
+static void mkb_free_device(struct mkb_device * device) {
+
+    readbuf_free(&device->buffer);
+    free(device);
+}
+
 static int mkb_close_device(void * user) {
 
     struct mkb_device * device = (struct mkb_device *) user;
 
+    pthread_mutex_lock(&devices_lock);
+
+    mkb_set_previous_name(DEVTYPE_KEYBOARD, device->keyboard, device->name);
+    mkb_set_previous_name(DEVTYPE_MOUSE, device->mouse, device->name);
+
     free(device->name);
 
     if (device->fd >= 0) {
@@ -59,24 +137,89 @@ static int mkb_close_device(void * user) {
         }
         fp_remove(device->fd);
         close(device->fd);
+        device->fd = -1;
     }
 
+    capture_remove_device(device->capture);
+
     GLIST_REMOVE(mkb_devices, device);
 
-    free(device);
+    pthread_mutex_unlock(&devices_lock);
+
+    if (device == reading) {
+        device->closed = 1; // freed once its input is processed
+    } else {
+        mkb_free_device(device);
+    }
 
     return 0;
 }
 
 static GLIST_INST(struct mkb_device, mkb_devices);
 
-#define LONG_BITS (sizeof(long) * 8)
-#define NLONGS(x) (((x) + LONG_BITS - 1) / LONG_BITS)
+/*
+ * A keyboard or a mouse that is plugged again gets the index it had before.
+ */
+static int mkb_allocate_index(unsigned char devtype, const char * name) {
+
+    int * num = (devtype == DEVTYPE_KEYBOARD) ? &k_num : &m_num;
+    char ** names = PREVIOUS_NAMES(devtype);
+    int i;
+    for (i = 0; i < *num; ++i) {
+        if (names[i] != NULL && !strcmp(names[i], name) && INDEX_TO_DEVICE(devtype)[i] == NULL) {
+            return i;
+        }
+    }
+    if (*num < GE_MAX_DEVICES) {
+        return (*num)++;
+    }
+    for (i = 0; i < *num; ++i) {
+        if (INDEX_TO_DEVICE(devtype)[i] == NULL) {
+            return i;
+        }
+    }
+    return -1;
+}
 
 static inline int BitIsSet(const unsigned long *array, int bit) {
     return !!(array[bit / LONG_BITS] & (1LL << (bit % LONG_BITS)));
 }
 
+static inline void SetBit(unsigned long *array, int bit, int value) {
+    if (value) {
+        array[bit / LONG_BITS] |= 1UL << (bit % LONG_BITS);
+    } else {
+        array[bit / LONG_BITS] &= ~(1UL << (bit % LONG_BITS));
+    }
+}
+
+/*
+ * Name a device, and give it a keyboard index and/or a mouse index.
+ */
+static int mkb_set_type(struct mkb_device * device, const char * name, int is_keyboard, int is_mouse) {
+
+    device->name = strdup(name);
+    if (device->name == NULL) {
+        PRINT_ERROR_ERRNO("strdup");
+        return -1;
+    }
+
+    if (is_keyboard) {
+        device->keyboard = mkb_allocate_index(DEVTYPE_KEYBOARD, name);
+    }
+    if (is_mouse) {
+        device->mouse = mkb_allocate_index(DEVTYPE_MOUSE, name);
+    }
+
+    if (device->keyboard < 0 && device->mouse < 0) {
+        PRINT_ERROR_OTHER("cannot add other devices: max device number reached");
+        free(device->name);
+        return -1;
+    }
+
+    return 0;
+}
+
 static int mkb_read_type(struct mkb_device * device, int fd) {
 
     char name[1024] = { 0 };
@@ -128,35 +271,84 @@ static int mkb_read_type(struct mkb_device * device, int fd) {
         return -1;
     }
 
-    device->name = strdup(name);
-    if (device->name == NULL) {
-        PRINT_ERROR_ERRNO("strdup");
-        return -1;
+    return mkb_set_type(device, name, has_keys, has_rel_axes || has_scroll);
+}
+
+static int (*event_callback)(GE_Event*) = NULL;
+
+static void mkb_report_device(int type, int id) {
+
+    if (id >= 0) {
+        GE_Event evt = { .device = { .type = type, .which = id } };
+        event_callback(&evt);
+        dispatch_flush();
     }
+}
+
+static int mkb_remove_device(void * user) {
+
+    struct mkb_device * device = (struct mkb_device *) user;
 
-    if (has_keys) {
-        device->keyboard = k_num;
-        k_num++;
+    if (hotplug) {
+        mkb_report_device(GE_KEYBOARDDEVICEREMOVED, device->keyboard);
+        mkb_report_device(GE_MOUSEDEVICEREMOVED, device->mouse);
     }
-    if (has_rel_axes || has_scroll) {
-        device->mouse = m_num;
-        m_num++;
+
+    return mkb_close_device(device);
+}
+
+static void mkb_flush_motion(struct mkb_device * device) {
+
+    if (device->motion.pending) {
+        GE_Event evt = { .motion = { .type = GE_MOUSEMOTION, .which = device->mouse,
+            .xrel = device->motion.xrel, .yrel = device->motion.yrel } };
+        device->motion.xrel = 0;
+        device->motion.yrel = 0;
+        device->motion.pending = 0;
+        event_callback(&evt);
     }
+}
 
-    return 0;
+static inline int motion_overflows(int accumulated, int value) {
+
+    return accumulated + value > INT16_MAX || accumulated + value < INT16_MIN;
 }
 
-static int (*event_callback)(GE_Event*) = NULL;
+static void mkb_resync(struct mkb_device * device);
 
-static void mkb_process_event(struct mkb_device * device, struct input_event* ie) {
+static void mkb_process_event(struct mkb_device * device, const struct input_event* ie) {
 
     GE_Event evt = { };
 
+    if (device->dropped) {
+        // the events until the next SYN_REPORT are incomplete
+        if (ie->type == EV_SYN && ie->code == SYN_REPORT) {
+            device->dropped = 0;
+            mkb_resync(device);
+        }
+        return;
+    }
+
     switch (ie->type) {
+    case EV_SYN:
+        if (ie->code == SYN_REPORT && motion_mode == GE_MOTION_FRAME) {
+            mkb_flush_motion(device);
+        } else if (ie->code == SYN_DROPPED) {
+            __atomic_store_n(&device->overflows, device->overflows + 1, __ATOMIC_RELAXED);
+            // the motion of the incomplete frame is dropped as well
+            device->motion.xrel = 0;
+            device->motion.yrel = 0;
+            device->motion.pending = 0;
+            device->dropped = 1;
+        }
+        return;
     case EV_KEY:
         if (ie->value > 1) {
             return;
         }
+        if (ie->code < KEY_CNT) {
+            SetBit(device->keys, ie->code, ie->value);
+        }
         break;
     case EV_MSC:
         if (ie->value > 1) {
@@ -174,7 +366,8 @@ static void mkb_process_event(struct mkb_device * device, struct input_event* ie
     }
     if (device->keyboard >= 0) {
         if (ie->type == EV_KEY) {
-            if (ie->code > 0 && ie->code < MAX_KEYNAMES) {
+            if (ie->code > 0 && ie->code < MAX_KEYNAMES
+                    && mask_accepts(GE_DEVICE_KEYBOARD, device->keyboard, ie->value ? GE_KEYDOWN : GE_KEYUP)) {
                 evt.type = ie->value ? GE_KEYDOWN : GE_KEYUP;
                 evt.key.which = device->keyboard;
                 evt.key.keysym = ie->code;
@@ -183,20 +376,34 @@ static void mkb_process_event(struct mkb_device * device, struct input_event* ie
     }
     if (device->mouse >= 0) {
         if (ie->type == EV_KEY) {
-            if (ie->code >= BTN_LEFT && ie->code <= BTN_TASK) {
+            if (ie->code >= BTN_LEFT && ie->code <= BTN_TASK
+                    && mask_accepts(GE_DEVICE_MOUSE, device->mouse, ie->value ? GE_MOUSEBUTTONDOWN : GE_MOUSEBUTTONUP)) {
                 evt.type = ie->value ? GE_MOUSEBUTTONDOWN : GE_MOUSEBUTTONUP;
                 evt.button.which = device->mouse;
                 evt.button.button = ie->code - BTN_MOUSE;
             }
         } else if (ie->type == EV_REL) {
+            if (ie->code == REL_X || ie->code == REL_Y) {
+                if (!mask_accepts(GE_DEVICE_MOUSE, device->mouse, GE_MOUSEMOTION)) {
+                    return;
+                }
+            } else if (!mask_accepts(GE_DEVICE_MOUSE, device->mouse, GE_MOUSEBUTTONDOWN)) {
+                return;
+            }
             if (ie->code == REL_X) {
-                evt.type = GE_MOUSEMOTION;
-                evt.motion.which = device->mouse;
-                evt.motion.xrel = ie->value;
+                if (motion_overflows(device->motion.xrel, ie->value)) {
+                    mkb_flush_motion(device);
+                }
+                device->motion.xrel += ie->value;
+                device->motion.pending = 1;
+                return;
             } else if (ie->code == REL_Y) {
-                evt.type = GE_MOUSEMOTION;
-                evt.motion.which = device->mouse;
-                evt.motion.yrel = ie->value;
+                if (motion_overflows(device->motion.yrel, ie->value)) {
+                    mkb_flush_motion(device);
+                }
+                device->motion.yrel += ie->value;
+                device->motion.pending = 1;
+                return;
             } else if (ie->code == REL_WHEEL) {
                 evt.type = GE_MOUSEBUTTONDOWN;
                 evt.button.which = device->mouse;
@@ -213,6 +420,8 @@ static void mkb_process_event(struct mkb_device * device, struct input_event* ie
      * Process evt.
      */
     if (evt.type != GE_NOEVENT) {
+        // report the motion that happened before this event first
+        mkb_flush_motion(device);
         eprintf("event from device: %s\n", device->name);
         eprintf("type: %d code: %d value: %d\n", ie->type, ie->code, ie->value);
         event_callback(&evt);
@@ -225,24 +434,176 @@ static void mkb_process_event(struct mkb_device * device, struct input_event* ie
     }
 }
 
-static int mkb_process_events(void * user) {
+/*
+ * After a SYN_DROPPED, get the current key and button states, and report the changes,
+ * so that no key or button is left pressed. Relative motion can't be recovered.
+ */
+static void mkb_resync(struct mkb_device * device) {
 
-    struct mkb_device * device = (struct mkb_device *) user;
+    if (device->fd < 0) {
+        return; // the state of a replayed device can't be read
+    }
+
+    unsigned long keys[NLONGS(KEY_CNT)] = { 0 };
+    if (ioctl(device->fd, EVIOCGKEY(sizeof(keys)), keys) < 0) {
+        PRINT_ERROR_ERRNO("ioctl EVIOCGKEY");
+        return;
+    }
+
+    unsigned int i;
+    for (i = 0; i < NLONGS(KEY_CNT); ++i) {
+        unsigned long changed = keys[i] ^ device->keys[i];
+        while (changed) {
+            unsigned int bit = __builtin_ctzl(changed);
+            changed &= changed - 1;
+            // the synthetic event gets the timestamp of the SYN_REPORT
+            struct input_event ie = { .type = EV_KEY, .code = i * LONG_BITS + bit, .value = (keys[i] >> bit) & 1 };
+            mkb_process_event(device, &ie);
+        }
+    }
+}
+
+/*
+ * Process the result of a read: a byte count, or -1 with errno set.
+ * Return -1 if the device was closed, in which case it is freed.
+ */
+static int mkb_process_read(struct mkb_device * device, const void * data, int res) {
 
-    static struct input_event ie[MAX_EVENTS];
+    struct mkb_device * previous = reading;
+    reading = device;
 
-    int res = read(device->fd, ie, sizeof(ie));
     if (res > 0) {
+        const struct input_event * ie = data;
+        gtime now = (device->monotonic && !STATS_ENABLED && device->capture < 0) ? 0 : gtime_gettime();
+        capture_data(device->capture, now, data, res);
         unsigned int j;
-        for (j = 0; j < res / sizeof(*ie); ++j) {
+        for (j = 0; j < res / sizeof(*ie) && !device->closed; ++j) {
+            if (device->monotonic) {
+                timestamp_set(EVENT_TIME(ie + j));
+                STATS_EVENT_TO_READ(device, EVENT_TIME(ie + j), now);
+            } else {
+                timestamp_set(now);
+            }
             mkb_process_event(device, ie + j);
         }
-    } else if (res < 0 && errno != EAGAIN) {
-        mkb_close_device(device);
+        if (motion_mode == GE_MOTION_READ && !device->closed) {
+            mkb_flush_motion(device);
+        }
+        dispatch_flush();
+        STATS_READ(device, res / sizeof(*ie));
+        STATS_READ_TO_CALLBACK(device, now);
+    } else if (res < 0) {
+        if (errno == EAGAIN) {
+            STATS_EAGAIN(device);
+        } else {
+            mkb_remove_device(device);
+        }
     }
+
+    reading = previous;
+
+    if (device->closed) {
+        mkb_free_device(device);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int mkb_process_events(void * user) {
+
+    struct mkb_device * device = (struct mkb_device *) user;
+
+    // a short read means the device queue is empty, so that this also works with edge-triggered polling
+    int res;
+    do {
+        res = readbuf_read(&device->buffer, device->fd);
+        if (mkb_process_read(device, device->buffer.data, res) < 0) {
+            break; // the device was closed
+        }
+    } while (res > 0 && res == (int) readbuf_bytes(&device->buffer));
+
     return 0;
 }
 
+#ifdef EVIOCSMASK
+/*
+ * Set a range of bits in an EVIOCSMASK code mask.
+ */
+static void mkb_set_codes(unsigned long * codes, unsigned int first, unsigned int last) {
+
+    unsigned int code;
+    for (code = first; code <= last; ++code) {
+        SetBit(codes, code, 1);
+    }
+}
+#endif
+
+/*
+ * Ask the kernel to drop the key, button and relative axis events that are filtered,
+ * so that they don't even wake the reading thread up, and get the current key states.
+ */
+static void mkb_apply_event_masks(struct mkb_device * device) {
+
+    if (device->fd < 0) {
+        return; // replayed devices are filtered in mkb_process_event
+    }
+
+#ifdef EVIOCSMASK
+    uint32_t keyboard_mask = (device->keyboard >= 0) ? mask_get(GE_DEVICE_KEYBOARD, device->keyboard) : 0;
+    uint32_t mouse_mask = (device->mouse >= 0) ? mask_get(GE_DEVICE_MOUSE, device->mouse) : 0;
+
+    uint32_t key_types = GE_EVENT_MASK(GE_KEYDOWN) | GE_EVENT_MASK(GE_KEYUP);
+    uint32_t button_types = GE_EVENT_MASK(GE_MOUSEBUTTONDOWN) | GE_EVENT_MASK(GE_MOUSEBUTTONUP);
+
+    unsigned long keys[NLONGS(KEY_CNT)] = { 0 };
+    unsigned long rels[NLONGS(REL_CNT)] = { 0 };
+
+    if ((keyboard_mask & key_types) == key_types && (mouse_mask & button_types) == button_types) {
+        mkb_set_codes(keys, 0, KEY_MAX);
+    } else {
+        if (keyboard_mask & key_types) {
+            mkb_set_codes(keys, 1, MAX_KEYNAMES - 1);
+        }
+        if (mouse_mask & button_types) {
+            mkb_set_codes(keys, BTN_LEFT, BTN_TASK);
+        }
+    }
+    if (mouse_mask & GE_EVENT_MASK(GE_MOUSEMOTION)) {
+        SetBit(rels, REL_X, 1);
+        SetBit(rels, REL_Y, 1);
+    }
+    if (mouse_mask & GE_EVENT_MASK(GE_MOUSEBUTTONDOWN)) {
+        mkb_set_codes(rels, REL_Z, REL_MAX);
+    }
+
+    struct input_mask masks[] = {
+        { .type = EV_KEY, .codes_size = sizeof(keys), .codes_ptr = (uintptr_t) keys },
+        { .type = EV_REL, .codes_size = sizeof(rels), .codes_ptr = (uintptr_t) rels },
+    };
+    unsigned int i;
+    for (i = 0; i < sizeof(masks) / sizeof(*masks); ++i) {
+        // older kernels don't support EVIOCSMASK, the events are then filtered in mkb_process_event
+        if (ioctl(device->fd, EVIOCSMASK, masks + i) < 0 && errno != EINVAL && errno != ENOTTY) {
+            PRINT_ERROR_ERRNO("ioctl EVIOCSMASK");
+        }
+    }
+#endif
+
+    // the keys that were filtered may have changed
+    if (ioctl(device->fd, EVIOCGKEY(sizeof(device->keys)), device->keys) < 0) {
+        PRINT_ERROR_ERRNO("ioctl EVIOCGKEY");
+    }
+}
+
+static void mkb_update_event_masks() {
+
+    struct mkb_device * device;
+    for (device = GLIST_BEGIN(mkb_devices); device != GLIST_END(mkb_devices); device = device->next) {
+        mkb_apply_event_masks(device);
+    }
+}
+
 #define DEV_INPUT "/dev/input"
 #define EV_DEV_NAME "event%u"
 
@@ -255,11 +616,126 @@ static int is_event_file(const struct dirent *dir) {
     return 0;
 }
 
+static GPOLL_REGISTER_FD fp_register = NULL;
+
+static void mkb_add_device(struct mkb_device * device) {
+
+    GLIST_ADD(mkb_devices, device);
+
+    if (device->keyboard >= 0) {
+        INDEX_TO_DEVICE(DEVTYPE_KEYBOARD)[device->keyboard] = device;
+    }
+    if (device->mouse >= 0) {
+        INDEX_TO_DEVICE(DEVTYPE_MOUSE)[device->mouse] = device;
+    }
+}
+
+/*
+ * Report an added device, with devices_lock released: the event callback may close it.
+ */
+static void mkb_report_added(int keyboard, int mouse) {
+
+    if (hotplug) {
+        mkb_report_device(GE_KEYBOARDDEVICEADDED, keyboard);
+        mkb_report_device(GE_MOUSEDEVICEADDED, mouse);
+    }
+}
+
+/*
+ * Open an event device, with devices_lock held.
+ * The indexes of the opened device are stored in keyboard and mouse, to be reported once the lock is released.
+ */
+static int mkb_open_device(const char * node, int * keyboard, int * mouse) {
+
+    unsigned int num;
+    if (sscanf(node, EV_DEV_NAME, &num) != 1) {
+        return -1;
+    }
+
+    struct mkb_device * current;
+    for (current = GLIST_BEGIN(mkb_devices); current != GLIST_END(mkb_devices); current = current->next) {
+        if (current->node == (int) num) {
+            return 0; // already opened
+        }
+    }
+
+    char path[strlen(DEV_INPUT) + sizeof('/') + strlen(node) + 1];
+    snprintf(path, sizeof(path), "%s/%s", DEV_INPUT, node);
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (fd == -1) {
+        // a hotplugged node may not be accessible yet, it will be opened again once its permissions are set
+        if ((!hotplug || errno != EACCES) && GLOG_LEVEL(GLOG_NAME,ERROR)) {
+            fprintf(stderr, "%s:%d %s: opening %s failed with error: %m\n", __FILE__, __LINE__, __func__, path);
+        }
+        return -1;
+    }
+
+    struct mkb_device * device = calloc(1, sizeof(*device));
+    if (device == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        close(fd);
+        return -1;
+    }
+
+    if (readbuf_init(&device->buffer, sizeof(struct input_event)) < 0) {
+        close(fd);
+        free(device);
+        return -1;
+    }
+
+    device->mouse = -1;
+    device->keyboard = -1;
+    if (mkb_read_type(device, fd) == -1) {
+        readbuf_free(&device->buffer);
+        close(fd);
+        free(device);
+        return -1;
+    }
+
+    device->fd = fd;
+    device->node = num;
+    device->replay = -1;
+    struct capture_device info = { .source = CAPTURE_SOURCE_MKB, .name = device->name,
+        .flags = ((device->mouse >= 0) ? CAPTURE_DEVICE_MOUSE : 0) | ((device->keyboard >= 0) ? CAPTURE_DEVICE_KEYBOARD : 0) };
+    device->capture = capture_add_device(&info);
+    // use the same clock as gtime_gettime() for event timestamps
+    int clock = CLOCK_MONOTONIC;
+    device->monotonic = (ioctl(device->fd, EVIOCSCLOCKID, &clock) == 0);
+    // this also gets the keys that are already pressed, so that a resync does not report them
+    mkb_apply_event_masks(device);
+    if (grab) {
+        ioctl(device->fd, EVIOCGRAB, (void *) 1);
+    }
+    GPOLL_CALLBACKS callbacks = { .fp_read = mkb_process_events, .fp_write = NULL, .fp_close =
+            mkb_remove_device };
+    fp_register(device->fd, device, &callbacks);
+    mkb_add_device(device);
+
+    *keyboard = device->keyboard;
+    *mouse = device->mouse;
+
+    return 0;
+}
+
+static int mkb_open(const char * node) {
+
+    int keyboard = -1;
+    int mouse = -1;
+
+    pthread_mutex_lock(&devices_lock);
+    int ret = mkb_open_device(node, &keyboard, &mouse);
+    pthread_mutex_unlock(&devices_lock);
+
+    mkb_report_added(keyboard, mouse);
+
+    return ret;
+}
+
 static int mkb_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(GE_Event*)) {
 
     int ret = 0;
     int i;
-    int fd;
 
     if (poll_interface->fp_register == NULL) {
         PRINT_ERROR_OTHER("fp_register is NULL");
@@ -280,6 +756,7 @@ static int mkb_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(GE_E
     }
 
     event_callback = callback;
+    fp_register = poll_interface->fp_register;
     fp_remove = poll_interface->fp_remove;
 
     struct dirent **namelist;
@@ -288,38 +765,7 @@ static int mkb_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(GE_E
     n = scandir(DEV_INPUT, &namelist, is_event_file, alphasort);
     if (n >= 0) {
         for (i = 0; i < n; ++i) {
-        	char device[strlen(DEV_INPUT) + sizeof('/') + strlen(namelist[i]->d_name) + 1];
-        	snprintf(device, sizeof(device), "%s/%s", DEV_INPUT, namelist[i]->d_name);
-
-            fd = open(device, O_RDONLY | O_NONBLOCK);
-            if (fd != -1) {
-                struct mkb_device * device = calloc(1, sizeof(*device));
-                if (device != NULL) {
-                    device->mouse = -1;
-                    device->keyboard = -1;
-                    if (mkb_read_type(device, fd) != -1) {
-                        device->fd = fd;
-                        if (grab) {
-                            ioctl(device->fd, EVIOCGRAB, (void *) 1);
-                        }
-                        GPOLL_CALLBACKS callbacks = { .fp_read = mkb_process_events, .fp_write = NULL, .fp_close =
-                                mkb_close_device };
-                        poll_interface->fp_register(device->fd, device, &callbacks);
-                        GLIST_ADD(mkb_devices, device);
-                    } else {
-                        close(fd);
-                        free(device);
-                    }
-                } else {
-                    PRINT_ERROR_ALLOC_FAILED("calloc");
-                    close(fd);
-                }
-            } else {
-                if (GLOG_LEVEL(GLOG_NAME,ERROR)) {
-                    fprintf(stderr, "%s:%d %s: opening %s failed with error: %m\n", __FILE__, __LINE__, __func__, device);
-                }
-            }
-
+            mkb_open(namelist[i]->d_name);
             free(namelist[i]);
         }
         free(namelist);
@@ -331,25 +777,160 @@ static int mkb_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(GE_E
     return ret;
 }
 
-static char* mkb_get_name(unsigned char devtype, int index) {
+static int mkb_init_capture(int (*callback)(GE_Event*)) {
 
-    struct mkb_device * device = GLIST_BEGIN(mkb_devices);
-    while (device != GLIST_END(mkb_devices)) {
-        switch(devtype) {
-        case DEVTYPE_MOUSE:
-            if (device->mouse == index) {
-                return device->name;
-            }
-            break;
-        case DEVTYPE_KEYBOARD:
-            if (device->keyboard == index) {
-                return device->name;
-            }
+    if (callback == NULL) {
+        PRINT_ERROR_OTHER("callback is NULL");
+        return -1;
+    }
+
+    k_num = 0;
+    m_num = 0;
+
+    event_callback = callback;
+
+    return 0;
+}
+
+/*
+ * Create a device that gets its input from a capture instead of an event device.
+ */
+static int mkb_open_capture(int id, const struct capture_device * info) {
+
+    if (info->source != CAPTURE_SOURCE_MKB) {
+        PRINT_ERROR_OTHER("not a mouse or keyboard capture");
+        return -1;
+    }
+
+    struct mkb_device * device = calloc(1, sizeof(*device));
+    if (device == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        return -1;
+    }
+
+    device->fd = -1;
+    device->node = -1;
+    device->mouse = -1;
+    device->keyboard = -1;
+    device->capture = -1;
+    device->replay = id;
+
+    pthread_mutex_lock(&devices_lock);
+
+    if (mkb_set_type(device, info->name, info->flags & CAPTURE_DEVICE_KEYBOARD, info->flags & CAPTURE_DEVICE_MOUSE) < 0) {
+        pthread_mutex_unlock(&devices_lock);
+        free(device);
+        return -1;
+    }
+
+    mkb_add_device(device);
+
+    int keyboard = device->keyboard;
+    int mouse = device->mouse;
+
+    pthread_mutex_unlock(&devices_lock);
+
+    mkb_report_added(keyboard, mouse);
+
+    return 0;
+}
+
+/*
+ * The list is walked with devices_lock held, as the reader threads may close other devices meanwhile.
+ * Replayed devices are closed by the replay itself, or with the sources locked, so that they outlive the lookup.
+ */
+static struct mkb_device * mkb_get_replayed(int id) {
+
+    pthread_mutex_lock(&devices_lock);
+
+    struct mkb_device * device;
+    for (device = GLIST_BEGIN(mkb_devices); device != GLIST_END(mkb_devices); device = device->next) {
+        if (device->replay == id) {
             break;
         }
-        device = device->next;
     }
-    return NULL;
+
+    pthread_mutex_unlock(&devices_lock);
+
+    return (device != GLIST_END(mkb_devices)) ? device : NULL;
+}
+
+static void mkb_process_capture(int id, const void * data, unsigned int size) {
+
+    struct mkb_device * device = mkb_get_replayed(id);
+    if (device != NULL) {
+        mkb_process_read(device, data, size);
+    }
+}
+
+static void mkb_close_capture(int id) {
+
+    struct mkb_device * device = mkb_get_replayed(id);
+    if (device != NULL) {
+        mkb_remove_device(device);
+    }
+}
+
+static struct mkb_device * mkb_get_device(unsigned char devtype, int index) {
+
+    if (index < 0 || index >= GE_MAX_DEVICES) {
+        return NULL;
+    }
+    return INDEX_TO_DEVICE(devtype)[index];
+}
+
+static char* mkb_get_name(unsigned char devtype, int index) {
+
+    struct mkb_device * device = mkb_get_device(devtype, index);
+    return (device != NULL) ? device->name : NULL;
+}
+
+/*
+ * The statistics and the overflow counts can be read from any thread, while devices are closed.
+ */
+static int mkb_get_stats(unsigned char devtype, int index, GE_Stats * stats) {
+
+    int ret = -1;
+    pthread_mutex_lock(&devices_lock);
+    struct mkb_device * device = mkb_get_device(devtype, index);
+    if (device != NULL) {
+        ret = STATS_GET(device, stats);
+    }
+    pthread_mutex_unlock(&devices_lock);
+    return ret;
+}
+
+static int mkb_get_mouse_stats(int index, GE_Stats * stats) {
+
+    return mkb_get_stats(DEVTYPE_MOUSE, index, stats);
+}
+
+static int mkb_get_keyboard_stats(int index, GE_Stats * stats) {
+
+    return mkb_get_stats(DEVTYPE_KEYBOARD, index, stats);
+}
+
+static int mkb_get_overflows(unsigned char devtype, int index, uint64_t * overflows) {
+
+    int ret = -1;
+    pthread_mutex_lock(&devices_lock);
+    struct mkb_device * device = mkb_get_device(devtype, index);
+    if (device != NULL) {
+        *overflows = __atomic_load_n(&device->overflows, __ATOMIC_RELAXED);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&devices_lock);
+    return ret;
+}
+
+static int mkb_get_mouse_overflows(int index, uint64_t * overflows) {
+
+    return mkb_get_overflows(DEVTYPE_MOUSE, index, overflows);
+}
+
+static int mkb_get_keyboard_overflows(int index, uint64_t * overflows) {
+
+    return mkb_get_overflows(DEVTYPE_KEYBOARD, index, overflows);
 }
 
 static const char * mkb_get_keyboard_name(int index) {
@@ -366,6 +947,16 @@ static void mkb_quit() {
 
     GLIST_CLEAN_ALL(mkb_devices, mkb_close_device)
 
+    int i;
+    for (i = 0; i < GE_MAX_DEVICES; ++i) {
+        free(PREVIOUS_NAMES(DEVTYPE_KEYBOARD)[i]);
+        PREVIOUS_NAMES(DEVTYPE_KEYBOARD)[i] = NULL;
+        free(PREVIOUS_NAMES(DEVTYPE_MOUSE)[i]);
+        PREVIOUS_NAMES(DEVTYPE_MOUSE)[i] = NULL;
+    }
+
+    hotplug = 0;
+
     if (!grab) {
         tcflush(STDIN_FILENO, TCIFLUSH);
     }
@@ -378,6 +969,8 @@ static int mkb_grab(int mode) {
     if (mode == GE_GRAB_ON) {
         enable = &one;
     }
+    // devices that are plugged later are grabbed as well
+    grab = (mode == GE_GRAB_ON);
     struct mkb_device * device = GLIST_BEGIN(mkb_devices);
     while (device != GLIST_END(mkb_devices)) {
         ioctl(device->fd, EVIOCGRAB, enable);
@@ -387,6 +980,16 @@ static int mkb_grab(int mode) {
     return mode;
 }
 
+static void mkb_set_motion_mode(GE_MotionMode mode) {
+
+    motion_mode = mode;
+}
+
+static void mkb_set_hotplug(int enable) {
+
+    hotplug = enable;
+}
+
 static int mkb_get_src() {
 
     return GE_MKB_SOURCE_PHYSICAL;
@@ -398,6 +1001,18 @@ static struct mkb_source source = {
     .grab = mkb_grab,
     .get_mouse_name = mkb_get_mouse_name,
     .get_keyboard_name = mkb_get_keyboard_name,
+    .get_mouse_stats = mkb_get_mouse_stats,
+    .get_keyboard_stats = mkb_get_keyboard_stats,
+    .get_mouse_overflows = mkb_get_mouse_overflows,
+    .get_keyboard_overflows = mkb_get_keyboard_overflows,
+    .set_motion_mode = mkb_set_motion_mode,
+    .set_hotplug = mkb_set_hotplug,
+    .update_event_masks = mkb_update_event_masks,
+    .open = mkb_open,
+    .init_capture = mkb_init_capture,
+    .open_capture = mkb_open_capture,
+    .process_capture = mkb_process_capture,
+    .close_capture = mkb_close_capture,
     .sync_process = NULL,
     .quit = mkb_quit,
 };
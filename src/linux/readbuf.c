@@ -0,0 +1,79 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <gimxcommon/include/gerror.h>
+
+#include "readbuf.h"
+
+// reads that use less than a quarter of the buffer for this many times in a row shrink it
+#define READBUF_SHRINK_READS 1024
+
+int readbuf_init(struct readbuf * buffer, size_t record_size) {
+
+    buffer->data = malloc(READBUF_MIN_RECORDS * record_size);
+    if (buffer->data == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("malloc");
+        return -1;
+    }
+    buffer->record_size = record_size;
+    buffer->capacity = READBUF_MIN_RECORDS;
+    buffer->last_records = 0;
+    buffer->small_reads = 0;
+
+    return 0;
+}
+
+static void readbuf_resize(struct readbuf * buffer, unsigned int capacity) {
+
+    // the records of the previous read were already processed, there is no need to keep them
+    void * data = malloc(capacity * buffer->record_size);
+    if (data == NULL) {
+        return; // keep the current buffer
+    }
+    free(buffer->data);
+    buffer->data = data;
+    buffer->capacity = capacity;
+    buffer->small_reads = 0;
+}
+
+/*
+ * Adapt the size to the previous read.
+ */
+static void readbuf_adapt(struct readbuf * buffer) {
+
+    if (buffer->last_records == buffer->capacity) {
+        // the previous read was truncated: read the rest of the burst with a larger buffer
+        if (buffer->capacity < READBUF_MAX_RECORDS) {
+            readbuf_resize(buffer, buffer->capacity * 2);
+        }
+    } else if (buffer->last_records < buffer->capacity / 4) {
+        if (buffer->capacity > READBUF_MIN_RECORDS && ++buffer->small_reads == READBUF_SHRINK_READS) {
+            readbuf_resize(buffer, buffer->capacity / 2);
+        }
+    } else {
+        buffer->small_reads = 0;
+    }
+}
+
+int readbuf_read(struct readbuf * buffer, int fd) {
+
+    readbuf_adapt(buffer);
+
+    int res = read(fd, buffer->data, readbuf_bytes(buffer));
+
+    buffer->last_records = (res > 0) ? res / buffer->record_size : 0;
+
+    return res;
+}
+
+void readbuf_free(struct readbuf * buffer) {
+
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+}
@@ -0,0 +1,44 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef READBUF_H_
+#define READBUF_H_
+
+#include <stddef.h>
+
+/*
+ * A per-device read buffer, sized from the observed bursts.
+ *
+ * The buffer grows when a read fills it, so that a burst is read with as few syscalls as possible,
+ * and shrinks back when the reads keep using a small part of it.
+ * Each device has its own buffer, so that devices can be read concurrently from several threads.
+ */
+struct readbuf {
+    void * data;
+    size_t record_size; // sizeof(struct js_event) or sizeof(struct input_event)
+    unsigned int capacity; // in records
+    unsigned int last_records; // the number of records of the last read
+    unsigned int small_reads; // the number of consecutive reads that used less than a quarter of the buffer
+};
+
+#define READBUF_MIN_RECORDS 64
+#define READBUF_MAX_RECORDS 4096
+
+int readbuf_init(struct readbuf * buffer, size_t record_size);
+
+/*
+ * Read as many records as possible, and return the number of bytes that were read (or -1, as read does).
+ * The records stay valid until the next read.
+ * A read that returns less than readbuf_bytes(buffer) means that the device queue is empty.
+ */
+int readbuf_read(struct readbuf * buffer, int fd);
+
+static inline size_t readbuf_bytes(const struct readbuf * buffer) {
+    return buffer->capacity * buffer->record_size;
+}
+
+void readbuf_free(struct readbuf * buffer);
+
+#endif /* READBUF_H_ */
@@ -0,0 +1,440 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include <ginput.h>
+#include <gimxcommon/include/gerror.h>
+
+#include "../reader.h"
+#include "../loop.h"
+#include "../queue.h"
+#include "../dispatch.h"
+#include "../timestamp.h"
+#include "../events.h"
+
+/*
+ * The reader thread runs the internal event loop, so that devices are read as soon as
+ * input is available, whatever the application thread is doing.
+ *
+ * Events are pushed into a lock-free queue together with their timestamps, and an eventfd
+ * is signaled once per wakeup. The application thread pops the events and delivers them
+ * to the callback, through the usual dispatch path.
+ *
+ * The event loop can be split into shards, each dispatched by its own reader thread, so that
+ * a busy device only delays the devices of its shard. Each shard has its own single-producer
+ * queue. The hidinput devices that are polled by ginput_periodic_task push their events from
+ * the application thread, into a multi-producer queue.
+ *
+ * The queues are either delivered one after the other, or merged in timestamp order.
+ */
+
+#define READER_QUEUE_SIZE 1024
+
+struct reader_event {
+    GE_Event event;
+    gtime timestamp;
+};
+
+struct reader_shard {
+    unsigned int index;
+    pthread_t thread;
+    int started;
+    int stop_fd; // wakes the reader thread up when stopping
+    struct queue * queue;
+};
+
+static struct {
+    int enabled;
+    GE_ReaderConfig config;
+    unsigned int nb_shards;
+    int ordered;
+    int locked;
+    int stop;
+    int event_fd; // signaled when events were queued
+    struct queue * queue; // the events pushed by the application thread
+    struct reader_shard shards[LOOP_MAX_SHARDS];
+} reader = { .nb_shards = 1, .event_fd = -1, .shards = { [0 ... LOOP_MAX_SHARDS - 1] = { .stop_fd = -1 } } };
+
+// the number of events pushed by the current thread since the last signal
+static __thread unsigned int pushed = 0;
+
+// the queue of the current reader thread, or NULL for the other threads
+static __thread struct queue * thread_queue = NULL;
+
+int reader_configure(const GE_ReaderConfig * config) {
+
+    if (config == NULL) {
+        reader.enabled = 0;
+        return 0;
+    }
+
+    if (config->priority < 0 || config->priority > sched_get_priority_max(SCHED_FIFO)) {
+        PRINT_ERROR_OTHER("invalid priority");
+        return -1;
+    }
+
+    if (config->cpu >= CPU_SETSIZE) {
+        PRINT_ERROR_OTHER("invalid cpu");
+        return -1;
+    }
+
+    reader.config = *config;
+    if (reader.config.queue_size == 0) {
+        reader.config.queue_size = READER_QUEUE_SIZE;
+    }
+    reader.enabled = 1;
+
+    return 0;
+}
+
+int reader_set_shards(unsigned int shards, int ordered) {
+
+    if (shards == 0 || shards > LOOP_MAX_SHARDS) {
+        PRINT_ERROR_OTHER("invalid shard count");
+        return -1;
+    }
+
+    reader.nb_shards = shards;
+    reader.ordered = ordered;
+
+    return 0;
+}
+
+unsigned int reader_get_shards() {
+
+    return reader.nb_shards;
+}
+
+int reader_enabled() {
+
+    return reader.enabled;
+}
+
+int reader_push(GE_Event * event) {
+
+    struct reader_event element = { .event = *event, .timestamp = timestamp_get() };
+
+    if (queue_push(thread_queue != NULL ? thread_queue : reader.queue, &element) < 0) {
+        return -1; // the application is too slow, the event is lost
+    }
+
+    ++pushed;
+
+    return 0;
+}
+
+void reader_signal() {
+
+    if (pushed == 0) {
+        return;
+    }
+
+    pushed = 0;
+
+    uint64_t value = 1;
+    if (write(reader.event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        PRINT_ERROR_ERRNO("write");
+    }
+}
+
+static int reader_wakeup(void * user) {
+
+    struct reader_shard * shard = (struct reader_shard *) user;
+
+    uint64_t value;
+    if (read(shard->stop_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        PRINT_ERROR_ERRNO("read");
+    }
+
+    return 0;
+}
+
+static void * reader_thread(void * arg) {
+
+    struct reader_shard * shard = (struct reader_shard *) arg;
+
+    thread_queue = shard->queue;
+
+    while (!__atomic_load_n(&reader.stop, __ATOMIC_ACQUIRE)) {
+        if (loop_dispatch_shard(shard->index, -1) < 0) {
+            break;
+        }
+        reader_signal();
+    }
+
+    return NULL;
+}
+
+static int reader_create_thread(struct reader_shard * shard) {
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    if (reader.config.priority > 0) {
+        struct sched_param param = { .sched_priority = reader.config.priority };
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+
+    if (reader.config.cpu >= 0) {
+        // each shard gets its own CPU
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(reader.config.cpu + shard->index, &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+
+    int ret = pthread_create(&shard->thread, &attr, reader_thread, shard);
+
+    pthread_attr_destroy(&attr);
+
+    if (ret != 0) {
+        errno = ret; // EPERM if the process is not allowed to use SCHED_FIFO
+        PRINT_ERROR_ERRNO("pthread_create");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int reader_init_shard(struct reader_shard * shard, unsigned int index) {
+
+    shard->index = index;
+
+    shard->queue = queue_create(reader.config.queue_size, sizeof(struct reader_event), 0);
+    if (shard->queue == NULL) {
+        return -1;
+    }
+
+    shard->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (shard->stop_fd < 0) {
+        PRINT_ERROR_ERRNO("eventfd");
+        return -1;
+    }
+
+    GPOLL_CALLBACKS callbacks = { .fp_read = reader_wakeup, .fp_write = NULL, .fp_close = NULL };
+    if (loop_register_shard(index, shard->stop_fd, shard, &callbacks) < 0) {
+        close(shard->stop_fd);
+        shard->stop_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int reader_start() {
+
+    if (reader.config.cpu >= 0 && reader.config.cpu + reader.nb_shards > CPU_SETSIZE) {
+        PRINT_ERROR_OTHER("invalid cpu");
+        return -1;
+    }
+
+    reader.queue = queue_create(reader.config.queue_size, sizeof(struct reader_event), 1);
+    if (reader.queue == NULL) {
+        return -1;
+    }
+
+    reader.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reader.event_fd < 0) {
+        PRINT_ERROR_ERRNO("eventfd");
+        reader_stop();
+        return -1;
+    }
+
+    unsigned int i;
+    for (i = 0; i < reader.nb_shards; ++i) {
+        if (reader_init_shard(reader.shards + i, i) < 0) {
+            reader_stop();
+            return -1;
+        }
+    }
+
+    if (reader.config.lock_memory) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+            PRINT_ERROR_ERRNO("mlockall");
+            reader_stop();
+            return -1;
+        }
+        reader.locked = 1;
+    }
+
+    reader.stop = 0;
+
+    for (i = 0; i < reader.nb_shards; ++i) {
+        if (reader_create_thread(reader.shards + i) < 0) {
+            reader_stop();
+            return -1;
+        }
+        reader.shards[i].started = 1;
+    }
+
+    return 0;
+}
+
+int reader_get_fd() {
+
+    return reader.event_fd;
+}
+
+static unsigned int reader_deliver_queue(struct queue * queue, int (*deliver)(GE_Event*)) {
+
+    static struct reader_event events[MAX_EVENTS];
+
+    unsigned int count = 0;
+    unsigned int nb;
+    while ((nb = queue_pop(queue, events, MAX_EVENTS)) > 0) {
+        unsigned int i;
+        for (i = 0; i < nb; ++i) {
+            timestamp_set(events[i].timestamp);
+            deliver(&events[i].event);
+        }
+        count += nb;
+    }
+
+    return count;
+}
+
+/*
+ * Deliver the events of each queue, one queue after the other.
+ */
+static int reader_deliver(int (*deliver)(GE_Event*)) {
+
+    int count = reader_deliver_queue(reader.queue, deliver);
+
+    unsigned int i;
+    for (i = 0; i < reader.nb_shards; ++i) {
+        count += reader_deliver_queue(reader.shards[i].queue, deliver);
+    }
+
+    return count;
+}
+
+static struct reader_event merged[(LOOP_MAX_SHARDS + 1) * MAX_EVENTS];
+
+static int compare_events(const void * first, const void * second) {
+
+    unsigned int i1 = *(const unsigned int *) first;
+    unsigned int i2 = *(const unsigned int *) second;
+
+    if (merged[i1].timestamp != merged[i2].timestamp) {
+        return (merged[i1].timestamp < merged[i2].timestamp) ? -1 : 1;
+    }
+    // keep the queue order for equal timestamps
+    return (i1 < i2) ? -1 : (i1 > i2);
+}
+
+/*
+ * Deliver the events of all queues in timestamp order.
+ * Each round takes up to MAX_EVENTS events from each queue, so that the merge window
+ * is bounded, and events that are queued later are delivered in a later round.
+ */
+static int reader_deliver_ordered(int (*deliver)(GE_Event*)) {
+
+    static unsigned int order[sizeof(merged) / sizeof(*merged)];
+
+    int count = 0;
+    unsigned int nb;
+    do {
+        nb = queue_pop(reader.queue, merged, MAX_EVENTS);
+        unsigned int i;
+        for (i = 0; i < reader.nb_shards; ++i) {
+            nb += queue_pop(reader.shards[i].queue, merged + nb, MAX_EVENTS);
+        }
+        for (i = 0; i < nb; ++i) {
+            order[i] = i;
+        }
+        qsort(order, nb, sizeof(*order), compare_events);
+        for (i = 0; i < nb; ++i) {
+            timestamp_set(merged[order[i]].timestamp);
+            deliver(&merged[order[i]].event);
+        }
+        count += nb;
+    } while (nb > 0);
+
+    return count;
+}
+
+int reader_dispatch(int timeout, int (*deliver)(GE_Event*)) {
+
+    if (reader.queue == NULL) {
+        PRINT_ERROR_OTHER("the reader thread is not started");
+        return -1;
+    }
+
+    struct pollfd pfd = { .fd = reader.event_fd, .events = POLLIN };
+    int ret = poll(&pfd, 1, timeout);
+    if (ret < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        PRINT_ERROR_ERRNO("poll");
+        return -1;
+    }
+
+    uint64_t value;
+    if (ret > 0 && read(reader.event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        PRINT_ERROR_ERRNO("read");
+    }
+
+    int count = reader.ordered ? reader_deliver_ordered(deliver) : reader_deliver(deliver);
+
+    dispatch_flush();
+
+    return count;
+}
+
+void reader_stop() {
+
+    __atomic_store_n(&reader.stop, 1, __ATOMIC_RELEASE);
+
+    unsigned int i;
+    for (i = 0; i < LOOP_MAX_SHARDS; ++i) {
+        struct reader_shard * shard = reader.shards + i;
+        if (shard->started) {
+            uint64_t value = 1;
+            if (write(shard->stop_fd, &value, sizeof(value)) < 0) {
+                PRINT_ERROR_ERRNO("write");
+            }
+            pthread_join(shard->thread, NULL);
+            shard->started = 0;
+        }
+    }
+
+    for (i = 0; i < LOOP_MAX_SHARDS; ++i) {
+        struct reader_shard * shard = reader.shards + i;
+        if (shard->stop_fd >= 0) {
+            loop_interface.fp_remove(shard->stop_fd);
+            close(shard->stop_fd);
+            shard->stop_fd = -1;
+        }
+        queue_destroy(shard->queue);
+        shard->queue = NULL;
+    }
+
+    if (reader.locked) {
+        munlockall();
+        reader.locked = 0;
+    }
+
+    if (reader.event_fd >= 0) {
+        close(reader.event_fd);
+        reader.event_fd = -1;
+    }
+
+    queue_destroy(reader.queue);
+    reader.queue = NULL;
+}
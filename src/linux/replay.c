@@ -0,0 +1,386 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include <ginput.h>
+#include <gimxcommon/include/gerror.h>
+
+#include "../replay.h"
+#include "../capture.h"
+#include "../events.h"
+#include "../hid/hidinput.h"
+
+#define REPLAY_BATCH 64 // the records that are played per wakeup, as fast as possible
+
+// the source that replays each device of the capture
+enum replay_kind {
+    REPLAY_NONE, // the device is not replayed
+    REPLAY_JS,
+    REPLAY_MKB,
+    REPLAY_HID,
+};
+
+static struct {
+    int enabled;
+    char * path;
+    GE_ReplayMode mode;
+    // the real sources, and the wrappers that replace them
+    struct js_source * js;
+    struct mkb_source * physical;
+    struct mkb_source * window;
+    struct js_source js_wrapper;
+    struct mkb_source physical_wrapper;
+    struct mkb_source window_wrapper;
+    struct mkb_source * mkb; // the mkb source that was initialized, or NULL
+    struct capture_reader * reader;
+    struct capture_record record; // the next record to play
+    const void * payload;
+    int pending; // 1 if record is valid
+    gtime offset; // from the capture time to the replay time
+    int timer_fd;
+    GPOLL_REMOVE_FD fp_remove;
+    uint8_t * devices; // enum replay_kind, by device id
+    int done;
+} replay = { .timer_fd = -1 };
+
+static void replay_open_device(int id, const void * payload, unsigned int size) {
+
+    struct capture_device device;
+    if (capture_parse_device(payload, size, &device) < 0) {
+        return;
+    }
+
+    int ret = -1;
+    uint8_t kind = REPLAY_NONE;
+
+    switch (device.source) {
+    case CAPTURE_SOURCE_JS:
+    case CAPTURE_SOURCE_JS_EVDEV:
+        ret = replay.js->open_capture(id, &device);
+        kind = REPLAY_JS;
+        break;
+    case CAPTURE_SOURCE_MKB:
+    case CAPTURE_SOURCE_XINPUT:
+        // mice and keyboards are only replayed by the source that recorded them
+        if (replay.mkb == ((device.source == CAPTURE_SOURCE_MKB) ? replay.physical : replay.window)) {
+            ret = replay.mkb->open_capture(id, &device);
+            kind = REPLAY_MKB;
+        }
+        break;
+    case CAPTURE_SOURCE_HID:
+        ret = hidinput_open_capture(id, &device);
+        kind = REPLAY_HID;
+        break;
+    }
+
+    replay.devices[id] = (ret == 0) ? kind : REPLAY_NONE;
+}
+
+static void replay_record() {
+
+    unsigned int id = replay.record.device;
+
+    switch (replay.record.type) {
+    case CAPTURE_RECORD_DEVICE:
+        replay_open_device(id, replay.payload, replay.record.size);
+        break;
+    case CAPTURE_RECORD_DATA:
+        switch (replay.devices[id]) {
+        case REPLAY_JS:
+            replay.js->process_capture(id, replay.payload, replay.record.size);
+            break;
+        case REPLAY_MKB:
+            replay.mkb->process_capture(id, replay.payload, replay.record.size);
+            break;
+        case REPLAY_HID:
+            hidinput_process_capture(id, replay.payload, replay.record.size);
+            break;
+        }
+        break;
+    case CAPTURE_RECORD_REMOVED:
+        switch (replay.devices[id]) {
+        case REPLAY_JS:
+            replay.js->close_capture(id);
+            break;
+        case REPLAY_MKB:
+            replay.mkb->close_capture(id);
+            break;
+        case REPLAY_HID:
+            hidinput_close_capture(id);
+            break;
+        }
+        replay.devices[id] = REPLAY_NONE;
+        break;
+    }
+}
+
+static void replay_next() {
+
+    int ret = capture_reader_next(replay.reader, &replay.record, &replay.payload);
+    replay.pending = (ret == 1);
+    if (ret <= 0) {
+        __atomic_store_n(&replay.done, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Wake up at the time of the next record, or right away to play as fast as possible.
+ */
+static void replay_arm() {
+
+    if (!replay.pending) {
+        return;
+    }
+
+    struct itimerspec its = { .it_interval = { 0, 0 } };
+    int flags = 0;
+    if (replay.mode == GE_REPLAY_REALTIME) {
+        gtime time = replay.record.timestamp + replay.offset;
+        its.it_value.tv_sec = time / 1000000000LL;
+        its.it_value.tv_nsec = time % 1000000000LL;
+        flags = TFD_TIMER_ABSTIME;
+    } else {
+        its.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(replay.timer_fd, flags, &its, NULL) < 0) {
+        PRINT_ERROR_ERRNO("timerfd_settime");
+    }
+}
+
+static int replay_process(void * user __attribute__((unused))) {
+
+    uint64_t expirations;
+    if (read(replay.timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        PRINT_ERROR_ERRNO("read");
+    }
+
+    gtime now = gtime_gettime();
+
+    unsigned int count;
+    for (count = 0; replay.pending; ++count) {
+        if (replay.mode == GE_REPLAY_REALTIME) {
+            if (replay.record.timestamp + replay.offset > now) {
+                break;
+            }
+        } else if (count == REPLAY_BATCH) {
+            break;
+        }
+        replay_record();
+        replay_next();
+    }
+
+    replay_arm();
+
+    return 0;
+}
+
+static int replay_close(void * user __attribute__((unused))) {
+
+    return 0;
+}
+
+/*
+ * Create the devices that were opened when the capture started, and start playing it.
+ */
+static int replay_start(const GPOLL_INTERFACE * poll_interface) {
+
+    replay.reader = capture_reader_open(replay.path);
+    if (replay.reader == NULL) {
+        return -1;
+    }
+
+    replay.devices = calloc(CAPTURE_MAX_DEVICES, sizeof(*replay.devices));
+    if (replay.devices == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        replay_quit();
+        return -1;
+    }
+
+    replay.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (replay.timer_fd < 0) {
+        PRINT_ERROR_ERRNO("timerfd_create");
+        replay_quit();
+        return -1;
+    }
+
+    GPOLL_CALLBACKS callbacks = { .fp_read = replay_process, .fp_write = NULL, .fp_close = replay_close };
+    if (poll_interface->fp_register(replay.timer_fd, NULL, &callbacks) < 0) {
+        close(replay.timer_fd);
+        replay.timer_fd = -1;
+        replay_quit();
+        return -1;
+    }
+    replay.fp_remove = poll_interface->fp_remove;
+
+    __atomic_store_n(&replay.done, 0, __ATOMIC_RELEASE);
+
+    replay_next();
+    if (replay.pending) {
+        replay.offset = gtime_gettime() - replay.record.timestamp;
+    }
+
+    while (replay.pending && replay.record.type == CAPTURE_RECORD_DEVICE) {
+        replay_record();
+        replay_next();
+    }
+
+    replay_arm();
+
+    return 0;
+}
+
+static int replay_js_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(GE_Event*)) {
+
+    if (replay.js->init_capture(callback) < 0 || hidinput_init_capture(callback) < 0) {
+        return -1;
+    }
+
+    return replay_start(poll_interface);
+}
+
+static int replay_mkb_init(struct mkb_source * source, int (*callback)(GE_Event*)) {
+
+    if (source->init_capture == NULL) {
+        PRINT_ERROR_OTHER("the mkb source can't replay a capture");
+        return -1;
+    }
+
+    replay.mkb = source;
+
+    return source->init_capture(callback);
+}
+
+static int replay_physical_init(const GPOLL_INTERFACE * poll_interface __attribute__((unused)),
+        int (*callback)(GE_Event*)) {
+
+    return replay_mkb_init(replay.physical, callback);
+}
+
+static int replay_window_init(const GPOLL_INTERFACE * poll_interface __attribute__((unused)),
+        int (*callback)(GE_Event*)) {
+
+    return replay_mkb_init(replay.window, callback);
+}
+
+/*
+ * The wrappers behave as the real sources, except that they create the devices of the capture
+ * at init, and that they ignore the device nodes that appear.
+ */
+static void replay_wrap_sources() {
+
+    replay.js_wrapper = *replay.js;
+    replay.js_wrapper.init = replay_js_init;
+    replay.js_wrapper.open = NULL;
+    ev_register_js_source(&replay.js_wrapper);
+
+    if (replay.physical != NULL) {
+        replay.physical_wrapper = *replay.physical;
+        replay.physical_wrapper.init = replay_physical_init;
+        replay.physical_wrapper.open = NULL;
+        ev_register_mkb_source(&replay.physical_wrapper);
+    }
+
+    if (replay.window != NULL) {
+        replay.window_wrapper = *replay.window;
+        replay.window_wrapper.init = replay_window_init;
+        replay.window_wrapper.open = NULL;
+        ev_register_mkb_source(&replay.window_wrapper);
+    }
+}
+
+static void replay_unwrap_sources() {
+
+    ev_register_js_source(replay.js);
+
+    if (replay.physical != NULL) {
+        ev_register_mkb_source(replay.physical);
+    }
+
+    if (replay.window != NULL) {
+        ev_register_mkb_source(replay.window);
+    }
+}
+
+int replay_configure(const char * path, GE_ReplayMode mode) {
+
+    if (path == NULL) {
+        if (replay.enabled) {
+            replay_unwrap_sources();
+            replay.enabled = 0;
+        }
+        free(replay.path);
+        replay.path = NULL;
+        return 0;
+    }
+
+    if (mode != GE_REPLAY_REALTIME && mode != GE_REPLAY_FAST) {
+        PRINT_ERROR_OTHER("invalid replay mode");
+        return -1;
+    }
+
+    if (!replay.enabled) {
+        replay.js = ev_get_js_source();
+        if (replay.js == NULL || replay.js->init_capture == NULL) {
+            PRINT_ERROR_OTHER("the joystick source can't replay a capture");
+            return -1;
+        }
+        replay.physical = ev_get_mkb_source(GE_MKB_SOURCE_PHYSICAL);
+        replay.window = ev_get_mkb_source(GE_MKB_SOURCE_WINDOW_SYSTEM);
+    }
+
+    char * copy = strdup(path);
+    if (copy == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("strdup");
+        return -1;
+    }
+    free(replay.path);
+    replay.path = copy;
+    replay.mode = mode;
+
+    if (!replay.enabled) {
+        replay_wrap_sources();
+        replay.enabled = 1;
+    }
+
+    return 0;
+}
+
+int replay_enabled() {
+
+    return replay.enabled;
+}
+
+int replay_done() {
+
+    return __atomic_load_n(&replay.done, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Stop playing the capture. The replayed devices are closed by the sources.
+ */
+void replay_quit() {
+
+    if (replay.timer_fd >= 0) {
+        replay.fp_remove(replay.timer_fd);
+        close(replay.timer_fd);
+        replay.timer_fd = -1;
+    }
+
+    capture_reader_close(replay.reader);
+    replay.reader = NULL;
+    replay.pending = 0;
+
+    free(replay.devices);
+    replay.devices = NULL;
+
+    replay.mkb = NULL;
+}
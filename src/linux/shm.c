@@ -0,0 +1,233 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ginput.h>
+#include <gimxcommon/include/gerror.h>
+
+#include "../shm.h"
+
+/*
+ * A memfd-backed ring of GE_ShmEvent, written by the library and read by any number of processes.
+ *
+ * The ring never blocks the producer: a slow consumer loses the oldest events, which it detects
+ * through the gaps in the sequence numbers. Each slot holds the sequence number of the event it
+ * contains, 0 while it is being written. A consumer copies a slot, then checks that its sequence
+ * number did not change during the copy (same principle as a seqlock).
+ *
+ * The sequence number is claimed with an atomic increment, so that events can be published
+ * from several threads.
+ */
+
+#define SHM_MAGIC 0x47455652 // "GEVR"
+#define SHM_VERSION 1
+
+#define CACHE_LINE_SIZE 64
+
+#define SHM_MIN_CAPACITY 64
+
+struct shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity; // a power of two
+    uint32_t event_size; // sizeof(GE_ShmEvent)
+    uint64_t head __attribute__((aligned(CACHE_LINE_SIZE))); // the last claimed sequence number
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct GE_ShmRing {
+    const struct shm_header * header;
+    const GE_ShmEvent * events;
+    size_t size;
+    uint32_t mask;
+    uint64_t next; // the next sequence number to read
+};
+
+static struct {
+    int fd;
+    struct shm_header * header;
+    GE_ShmEvent * events;
+    size_t size;
+    uint32_t mask;
+} producer = { .fd = -1 };
+
+static size_t shm_size(uint32_t capacity) {
+
+    return sizeof(struct shm_header) + (size_t) capacity * sizeof(GE_ShmEvent);
+}
+
+int shm_init(unsigned int capacity) {
+
+    if (producer.header != NULL) {
+        PRINT_ERROR_OTHER("the shared ring is already created");
+        return -1;
+    }
+
+    uint32_t size = SHM_MIN_CAPACITY;
+    while (size < capacity && size < (1U << 30)) {
+        size <<= 1;
+    }
+
+    int fd = memfd_create("ginput", MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        PRINT_ERROR_ERRNO("memfd_create");
+        return -1;
+    }
+
+    if (ftruncate(fd, shm_size(size)) < 0) {
+        PRINT_ERROR_ERRNO("ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    // consumers rely on the size of the ring
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        PRINT_ERROR_ERRNO("fcntl F_ADD_SEALS");
+        close(fd);
+        return -1;
+    }
+
+    void * ptr = mmap(NULL, shm_size(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        PRINT_ERROR_ERRNO("mmap");
+        close(fd);
+        return -1;
+    }
+
+    producer.fd = fd;
+    producer.header = ptr;
+    producer.events = (GE_ShmEvent *) (producer.header + 1);
+    producer.size = shm_size(size);
+    producer.mask = size - 1;
+
+    producer.header->capacity = size;
+    producer.header->event_size = sizeof(GE_ShmEvent);
+    producer.header->version = SHM_VERSION;
+    __atomic_store_n(&producer.header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+    return fd;
+}
+
+int shm_enabled() {
+
+    return producer.header != NULL;
+}
+
+void shm_publish(const GE_Event * event, gtime timestamp) {
+
+    uint64_t seq = __atomic_add_fetch(&producer.header->head, 1, __ATOMIC_RELAXED);
+    GE_ShmEvent * slot = producer.events + (seq & producer.mask);
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->timestamp = timestamp;
+    slot->event = *event;
+    __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+}
+
+void shm_quit() {
+
+    if (producer.header != NULL) {
+        munmap(producer.header, producer.size);
+        close(producer.fd);
+        producer.header = NULL;
+        producer.events = NULL;
+        producer.fd = -1;
+    }
+}
+
+GE_ShmRing * ginput_shm_open(int fd) {
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        PRINT_ERROR_ERRNO("fstat");
+        return NULL;
+    }
+
+    if ((size_t) st.st_size < sizeof(struct shm_header)) {
+        PRINT_ERROR_OTHER("not a ginput shared ring");
+        return NULL;
+    }
+
+    void * ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        PRINT_ERROR_ERRNO("mmap");
+        return NULL;
+    }
+
+    const struct shm_header * header = ptr;
+
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC || header->version != SHM_VERSION
+            || header->event_size != sizeof(GE_ShmEvent) || header->capacity == 0
+            || (header->capacity & (header->capacity - 1)) || shm_size(header->capacity) > (size_t) st.st_size) {
+        PRINT_ERROR_OTHER("not a ginput shared ring");
+        munmap(ptr, st.st_size);
+        return NULL;
+    }
+
+    GE_ShmRing * ring = calloc(1, sizeof(*ring));
+    if (ring == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        munmap(ptr, st.st_size);
+        return NULL;
+    }
+
+    ring->header = header;
+    ring->events = (const GE_ShmEvent *) (header + 1);
+    ring->size = st.st_size;
+    ring->mask = header->capacity - 1;
+    ring->next = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE) + 1;
+
+    return ring;
+}
+
+int ginput_shm_read(GE_ShmRing * ring, GE_ShmEvent * events, int numevents) {
+
+    if (ring == NULL || events == NULL || numevents <= 0) {
+        return 0;
+    }
+
+    uint64_t head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+
+    // skip the events that were already overwritten
+    if (head >= ring->next && head - ring->next > ring->mask) {
+        ring->next = head - ring->mask;
+    }
+
+    int count = 0;
+    while (count < numevents && ring->next <= head) {
+        const GE_ShmEvent * slot = ring->events + (ring->next & ring->mask);
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == 0 || seq < ring->next) {
+            break; // not published yet
+        }
+        if (seq == ring->next) {
+            events[count] = *slot;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+                ++count;
+            }
+        }
+        // the slot is skipped if it was overwritten, before or during the copy
+        ++ring->next;
+    }
+
+    return count;
+}
+
+void ginput_shm_close(GE_ShmRing * ring) {
+
+    if (ring != NULL) {
+        munmap((void *) ring->header, ring->size);
+        free(ring);
+    }
+}
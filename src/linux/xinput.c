@@ -16,6 +16,10 @@
 #include <gimxcommon/include/glist.h>
 #include <gimxlog/include/glog.h>
 #include "../events.h"
+#include "../timestamp.h"
+#include "../dispatch.h"
+#include "../mask.h"
+#include "../capture.h"
 
 GLOG_GET(GLOG_NAME)
 
@@ -25,6 +29,7 @@ static int xi_opcode;
 
 #define DEVTYPE_KEYBOARD 0x01
 #define DEVTYPE_MOUSE    0x02
+#define DEVTYPE_NB       2
 
 static GPOLL_REMOVE_FD fp_remove = NULL;
 
@@ -42,11 +47,28 @@ struct xinput_device
   int keyboard;
   char* name;
   unsigned int index;
+  int capture; // the id of the device in the capture that is recorded, or -1
+  int replay; // the id of the device in the capture that is replayed, or -1 if it is a real device
   GLIST_LINK(struct xinput_device);
 };
 
+/*
+ * The capture record of an XIRawEvent: only what is needed to translate it.
+ */
+struct xinput_capture_event
+{
+  int32_t evtype;
+  int32_t detail;
+  double raw_values[2]; // the x and y motion, 0 if not set
+};
+
 static struct xinput_device * device_index[GE_MAX_DEVICES];
 
+// the keyboards and mice, by index
+static struct xinput_device * index_to_device[DEVTYPE_NB][GE_MAX_DEVICES];
+
+#define INDEX_TO_DEVICE(DEVTYPE) index_to_device[(DEVTYPE) - 1]
+
 static void xinput_quit();
 
 static int xinput_close(void * user) {
@@ -57,8 +79,17 @@ static int xinput_close(void * user) {
         device_index[device->index] = NULL;
     }
 
+    if (device->keyboard >= 0) {
+        INDEX_TO_DEVICE(DEVTYPE_KEYBOARD)[device->keyboard] = NULL;
+    }
+    if (device->mouse >= 0) {
+        INDEX_TO_DEVICE(DEVTYPE_MOUSE)[device->mouse] = NULL;
+    }
+
     free(device->name);
 
+    capture_remove_device(device->capture);
+
     GLIST_REMOVE(x_devices, device);
 
     free(device);
@@ -94,46 +125,49 @@ static inline uint8_t get_button(int detail) {
     }
 }
 
-static void xinput_process_event(XIRawEvent* revent) {
+static void xinput_process_raw(struct xinput_device * device, const struct xinput_capture_event * revent) {
 
     GE_Event evt = { };
-    int i;
-
-    //ignore events from master device
-    if (revent->deviceid != revent->sourceid || revent->sourceid >= (int) (sizeof(device_index) / sizeof(*device_index))) {
-        return;
-    }
-
-    struct xinput_device * device = device_index[revent->sourceid];
-    if (device == NULL) {
-        return;
-    }
 
     switch (revent->evtype) {
     case XI_RawMotion:
+        if (device->mouse < 0 || !mask_accepts(GE_DEVICE_MOUSE, device->mouse, GE_MOUSEMOTION)) {
+            return;
+        }
         evt.type = GE_MOUSEMOTION;
         evt.motion.which = device->mouse;
-        i = 0;
-        evt.motion.xrel = XIMaskIsSet(revent->valuators.mask, 0) ? revent->raw_values[i++] : 0;
-        evt.motion.yrel = XIMaskIsSet(revent->valuators.mask, 1) ? revent->raw_values[i++] : 0;
+        evt.motion.xrel = revent->raw_values[0];
+        evt.motion.yrel = revent->raw_values[1];
         break;
     case XI_RawButtonPress:
+        if (device->mouse < 0 || !mask_accepts(GE_DEVICE_MOUSE, device->mouse, GE_MOUSEBUTTONDOWN)) {
+            return;
+        }
         evt.type = GE_MOUSEBUTTONDOWN;
         evt.button.which = device->mouse;
         evt.button.button = get_button(revent->detail);
         break;
     case XI_RawButtonRelease:
+        if (device->mouse < 0 || !mask_accepts(GE_DEVICE_MOUSE, device->mouse, GE_MOUSEBUTTONUP)) {
+            return;
+        }
         evt.type = GE_MOUSEBUTTONUP;
         evt.button.which = device->mouse;
         evt.button.button = get_button(revent->detail);
         break;
     case XI_RawKeyPress: {
+        if (device->keyboard < 0 || !mask_accepts(GE_DEVICE_KEYBOARD, device->keyboard, GE_KEYDOWN)) {
+            return;
+        }
         evt.type = GE_KEYDOWN;
         evt.button.which = device->keyboard;
         evt.button.button = revent->detail - 8;
         break;
     }
     case XI_RawKeyRelease: {
+        if (device->keyboard < 0 || !mask_accepts(GE_DEVICE_KEYBOARD, device->keyboard, GE_KEYUP)) {
+            return;
+        }
         evt.type = GE_KEYUP;
         evt.button.which = device->keyboard;
         evt.button.button = revent->detail - 8;
@@ -151,6 +185,32 @@ static void xinput_process_event(XIRawEvent* revent) {
     }
 }
 
+static void xinput_process_event(XIRawEvent* revent) {
+
+    //ignore events from master device
+    if (revent->deviceid != revent->sourceid || revent->sourceid >= (int) (sizeof(device_index) / sizeof(*device_index))) {
+        return;
+    }
+
+    struct xinput_device * device = device_index[revent->sourceid];
+    if (device == NULL) {
+        return;
+    }
+
+    struct xinput_capture_event event = { .evtype = revent->evtype, .detail = revent->detail };
+    if (revent->evtype == XI_RawMotion) {
+        int i = 0;
+        event.raw_values[0] = XIMaskIsSet(revent->valuators.mask, 0) ? revent->raw_values[i++] : 0;
+        event.raw_values[1] = XIMaskIsSet(revent->valuators.mask, 1) ? revent->raw_values[i++] : 0;
+    }
+
+    if (device->capture >= 0) {
+        capture_data(device->capture, gtime_gettime(), &event, sizeof(event));
+    }
+
+    xinput_process_raw(device, &event);
+}
+
 static int xinput_process_events(void * user __attribute__((unused))) {
 
     XEvent ev;
@@ -161,6 +221,7 @@ static int xinput_process_events(void * user __attribute__((unused))) {
         XPending(dpy);
 
         XNextEvent(dpy, &ev);
+        timestamp_set(gtime_gettime());
         if (XGetEventData(dpy, cookie)) {
             XIRawEvent* revent = cookie->data;
 
@@ -172,28 +233,65 @@ static int xinput_process_events(void * user __attribute__((unused))) {
         }
     }
 
+    dispatch_flush();
+
     return 0;
 }
 
-static Window create_win(Display *dpy) {
+/*
+ * Only select the raw events that are accepted for some devices, so that the X server
+ * does not send the others.
+ */
+static void select_events(Display *dpy) {
 
     XIEventMask mask;
 
-    Window win = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, 1, 1, 0, 0, 0);
+    uint32_t mouse_mask = mask_get(GE_DEVICE_MOUSE, -1);
+    uint32_t keyboard_mask = mask_get(GE_DEVICE_KEYBOARD, -1);
 
     mask.deviceid = XIAllDevices;
     mask.mask_len = XIMaskLen(XI_RawMotion);
     mask.mask = calloc(mask.mask_len, sizeof(char));
+    if (mask.mask == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        return;
+    }
 
-    XISetMask(mask.mask, XI_RawButtonPress);
-    XISetMask(mask.mask, XI_RawButtonRelease);
-    XISetMask(mask.mask, XI_RawKeyPress);
-    XISetMask(mask.mask, XI_RawKeyRelease);
-    XISetMask(mask.mask, XI_RawMotion);
+    if (mouse_mask & GE_EVENT_MASK(GE_MOUSEBUTTONDOWN)) {
+        XISetMask(mask.mask, XI_RawButtonPress);
+    }
+    if (mouse_mask & GE_EVENT_MASK(GE_MOUSEBUTTONUP)) {
+        XISetMask(mask.mask, XI_RawButtonRelease);
+    }
+    if (keyboard_mask & GE_EVENT_MASK(GE_KEYDOWN)) {
+        XISetMask(mask.mask, XI_RawKeyPress);
+    }
+    if (keyboard_mask & GE_EVENT_MASK(GE_KEYUP)) {
+        XISetMask(mask.mask, XI_RawKeyRelease);
+    }
+    if (mouse_mask & GE_EVENT_MASK(GE_MOUSEMOTION)) {
+        XISetMask(mask.mask, XI_RawMotion);
+    }
 
     XISelectEvents(dpy, DefaultRootWindow(dpy), &mask, 1);
 
     free(mask.mask);
+}
+
+static void xinput_update_event_masks() {
+
+    if (dpy != NULL) {
+        select_events(dpy);
+        XFlush(dpy);
+    }
+}
+
+static Window create_win(Display *dpy) {
+
+    Window win = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, 1, 1, 0, 0, 0);
+
+    select_events(dpy);
+
     XMapWindow(dpy, win);
     XSync(dpy, True);
 
@@ -292,6 +390,7 @@ static int xinput_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(G
 
         device->mouse = -1;
         device->keyboard = -1;
+        device->replay = -1;
 
         device_index[xdevice->deviceid] = device;
         device->index = xdevice->deviceid;
@@ -299,13 +398,19 @@ static int xinput_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(G
 
         if (hasKeys) {
             device->keyboard = k_num;
+            INDEX_TO_DEVICE(DEVTYPE_KEYBOARD)[k_num] = device;
             ++k_num;
         }
         if (hasButtons || hasAxes) {
             device->mouse = m_num;
+            INDEX_TO_DEVICE(DEVTYPE_MOUSE)[m_num] = device;
             ++m_num;
         }
 
+        struct capture_device info = { .source = CAPTURE_SOURCE_XINPUT, .name = device->name,
+            .flags = (hasKeys ? CAPTURE_DEVICE_KEYBOARD : 0) | ((hasButtons || hasAxes) ? CAPTURE_DEVICE_MOUSE : 0) };
+        device->capture = capture_add_device(&info);
+
         GLIST_ADD(x_devices, device);
     }
 
@@ -330,6 +435,104 @@ static int xinput_init(const GPOLL_INTERFACE * poll_interface, int (*callback)(G
     return ret;
 }
 
+static int xinput_init_capture(int (*callback)(GE_Event*)) {
+
+    if (callback == NULL) {
+        PRINT_ERROR_OTHER("callback is NULL");
+        return -1;
+    }
+
+    event_callback = callback;
+
+    return 0;
+}
+
+static int xinput_allocate_index(unsigned char devtype) {
+
+    int i;
+    for (i = 0; i < GE_MAX_DEVICES; ++i) {
+        if (INDEX_TO_DEVICE(devtype)[i] == NULL) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Create a device that gets its input from a capture instead of the X server.
+ */
+static int xinput_open_capture(int id, const struct capture_device * info) {
+
+    if (info->source != CAPTURE_SOURCE_XINPUT) {
+        PRINT_ERROR_OTHER("not an XInput capture");
+        return -1;
+    }
+
+    struct xinput_device * device = calloc(1, sizeof(*device));
+    if (device == NULL) {
+        PRINT_ERROR_ALLOC_FAILED("calloc");
+        return -1;
+    }
+
+    device->mouse = (info->flags & CAPTURE_DEVICE_MOUSE) ? xinput_allocate_index(DEVTYPE_MOUSE) : -1;
+    device->keyboard = (info->flags & CAPTURE_DEVICE_KEYBOARD) ? xinput_allocate_index(DEVTYPE_KEYBOARD) : -1;
+    if (device->mouse < 0 && device->keyboard < 0) {
+        PRINT_ERROR_OTHER("cannot add other devices: max device number reached");
+        free(device);
+        return -1;
+    }
+
+    device->name = strdup(info->name);
+    device->index = sizeof(device_index) / sizeof(*device_index); // not an X device
+    device->capture = -1;
+    device->replay = id;
+
+    if (device->keyboard >= 0) {
+        INDEX_TO_DEVICE(DEVTYPE_KEYBOARD)[device->keyboard] = device;
+    }
+    if (device->mouse >= 0) {
+        INDEX_TO_DEVICE(DEVTYPE_MOUSE)[device->mouse] = device;
+    }
+
+    GLIST_ADD(x_devices, device);
+
+    return 0;
+}
+
+static struct xinput_device * xinput_get_replayed(int id) {
+
+    struct xinput_device * device;
+    for (device = GLIST_BEGIN(x_devices); device != GLIST_END(x_devices); device = device->next) {
+        if (device->replay == id) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+static void xinput_process_capture(int id, const void * data, unsigned int size) {
+
+    struct xinput_device * device = xinput_get_replayed(id);
+    if (device == NULL || size != sizeof(struct xinput_capture_event)) {
+        return;
+    }
+
+    struct xinput_capture_event event;
+    memcpy(&event, data, sizeof(event));
+
+    timestamp_set(gtime_gettime());
+    xinput_process_raw(device, &event);
+    dispatch_flush();
+}
+
+static void xinput_close_capture(int id) {
+
+    struct xinput_device * device = xinput_get_replayed(id);
+    if (device != NULL) {
+        xinput_close(device);
+    }
+}
+
 static void xinput_quit() {
 
     GLIST_CLEAN_ALL(x_devices, xinput_close)
@@ -352,6 +555,10 @@ static void xinput_quit() {
  */
 static int xinput_grab(int mode) {
 
+    if (dpy == NULL) {
+        return mode; // replaying a capture
+    }
+
     int i = 0;
     while (XGrabPointer(dpy, win, True, 0, GrabModeAsync, GrabModeAsync, win, None, CurrentTime) != GrabSuccess
             && i < 50) {
@@ -364,23 +571,10 @@ static int xinput_grab(int mode) {
 
 static char* get_name(unsigned char devtype, int index) {
 
-    struct xinput_device * device = GLIST_BEGIN(x_devices);
-    while (device != GLIST_END(x_devices)) {
-        switch(devtype) {
-        case DEVTYPE_MOUSE:
-            if (device->mouse == index) {
-                return device->name;
-            }
-            break;
-        case DEVTYPE_KEYBOARD:
-            if (device->keyboard == index) {
-                return device->name;
-            }
-            break;
-        }
-        device = device->next;
+    if (index < 0 || index >= GE_MAX_DEVICES || INDEX_TO_DEVICE(devtype)[index] == NULL) {
+        return NULL;
     }
-    return NULL;
+    return INDEX_TO_DEVICE(devtype)[index]->name;
 }
 
 const char* xinput_get_mouse_name(int index) {
@@ -404,6 +598,18 @@ static struct mkb_source source = {
     .grab = xinput_grab,
     .get_mouse_name = xinput_get_mouse_name,
     .get_keyboard_name = xinput_get_keyboard_name,
+    .get_mouse_stats = NULL,
+    .get_keyboard_stats = NULL,
+    .get_mouse_overflows = NULL,
+    .get_keyboard_overflows = NULL,
+    .set_motion_mode = NULL,
+    .set_hotplug = NULL,
+    .update_event_masks = xinput_update_event_masks,
+    .open = NULL,
+    .init_capture = xinput_init_capture,
+    .open_capture = xinput_open_capture,
+    .process_capture = xinput_process_capture,
+    .close_capture = xinput_close_capture,
     .sync_process = NULL,
     .quit = xinput_quit,
 };
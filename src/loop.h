@@ -0,0 +1,47 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef LOOP_H_
+#define LOOP_H_
+
+#include <gimxpoll/include/gpoll.h>
+
+/*
+ * The internal epoll event loop (Linux only).
+ *
+ * loop_interface registers fds in level-triggered mode.
+ * loop_interface_edge registers fds in edge-triggered mode, for sources
+ * that read until there is nothing left to read on each wakeup.
+ * loop_interface_exclusive registers fds in edge-triggered mode, for sources
+ * whose callbacks may touch any device (e.g. hotplug), so that they never run
+ * concurrently with the callbacks of other shards.
+ */
+extern const GPOLL_INTERFACE loop_interface;
+extern const GPOLL_INTERFACE loop_interface_edge;
+extern const GPOLL_INTERFACE loop_interface_exclusive;
+
+#define LOOP_MAX_SHARDS 16
+
+/*
+ * Create the loop, split into the given number of shards.
+ * The fds are spread across the shards as they are registered.
+ */
+int loop_init(unsigned int shards);
+unsigned int loop_get_shards();
+int loop_get_fd();
+int loop_dispatch(int timeout);
+int loop_dispatch_shard(unsigned int shard, int timeout);
+// register a level-triggered fd in a given shard
+int loop_register_shard(unsigned int shard, int fd, void * user, const GPOLL_CALLBACKS * callbacks);
+void loop_quit();
+
+/*
+ * Serialize the calls to the sources with the callbacks run by loop_dispatch.
+ * The lock can be taken again by a thread that holds it, e.g. from the event callback.
+ */
+void loop_lock();
+void loop_unlock();
+
+#endif /* LOOP_H_ */
@@ -0,0 +1,85 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <string.h>
+#include "mask.h"
+
+uint32_t mask_filtered[MASK_DEVICE_TYPES][GE_MAX_DEVICES];
+
+/*
+ * The filtered types set by the application, for each device type and for each device.
+ * mask_filtered holds their union.
+ */
+static uint32_t type_filtered[MASK_DEVICE_TYPES];
+static uint32_t device_filtered[MASK_DEVICE_TYPES][GE_MAX_DEVICES];
+
+uint32_t mask_get(GE_DeviceType type, int id)
+{
+  if (id < 0)
+  {
+    return ~__atomic_load_n(type_filtered + type, __ATOMIC_RELAXED);
+  }
+  return ~__atomic_load_n(&mask_filtered[type][id], __ATOMIC_RELAXED);
+}
+
+int mask_accepts_event(const GE_Event * event)
+{
+  GE_DeviceType type;
+
+  switch (event->type)
+  {
+    case GE_KEYDOWN:
+    case GE_KEYUP:
+    case GE_KEYBOARDDEVICEADDED:
+    case GE_KEYBOARDDEVICEREMOVED:
+      type = GE_DEVICE_KEYBOARD;
+      break;
+    case GE_MOUSEMOTION:
+    case GE_MOUSEBUTTONDOWN:
+    case GE_MOUSEBUTTONUP:
+    case GE_MOUSEDEVICEADDED:
+    case GE_MOUSEDEVICEREMOVED:
+      type = GE_DEVICE_MOUSE;
+      break;
+    case GE_JOYAXISMOTION:
+    case GE_JOYHATMOTION:
+    case GE_JOYBUTTONDOWN:
+    case GE_JOYBUTTONUP:
+    case GE_JOYDEVICEADDED:
+    case GE_JOYDEVICEREMOVED:
+      type = GE_DEVICE_JOYSTICK;
+      break;
+    default:
+      return 1;
+  }
+
+  return mask_accepts(type, event->which, event->type);
+}
+
+void mask_set(GE_DeviceType type, int id, uint32_t mask)
+{
+  int i;
+
+  if (id < 0)
+  {
+    __atomic_store_n(type_filtered + type, ~mask, __ATOMIC_RELAXED);
+    for (i = 0; i < GE_MAX_DEVICES; ++i)
+    {
+      __atomic_store_n(&mask_filtered[type][i], ~mask | device_filtered[type][i], __ATOMIC_RELAXED);
+    }
+  }
+  else
+  {
+    device_filtered[type][id] = ~mask;
+    __atomic_store_n(&mask_filtered[type][id], type_filtered[type] | ~mask, __ATOMIC_RELAXED);
+  }
+}
+
+void mask_reset()
+{
+  memset(type_filtered, 0x00, sizeof(type_filtered));
+  memset(device_filtered, 0x00, sizeof(device_filtered));
+  memset(mask_filtered, 0x00, sizeof(mask_filtered));
+}
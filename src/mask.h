@@ -0,0 +1,45 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef MASK_H_
+#define MASK_H_
+
+#include <ginput.h>
+
+#define MASK_DEVICE_TYPES (GE_DEVICE_KEYBOARD + 1)
+
+/*
+ * The event types that are filtered out, for each device (the device mask and the mask of its type).
+ * Bits are set for the filtered types, so that no event is filtered by default.
+ */
+extern uint32_t mask_filtered[MASK_DEVICE_TYPES][GE_MAX_DEVICES];
+
+/*
+ * Check if an event type is accepted for a device.
+ * Sources call this before translating their input, so that filtered events cost as little as possible.
+ */
+static inline int mask_accepts(GE_DeviceType type, int id, GE_EventType event_type)
+{
+  return !(__atomic_load_n(&mask_filtered[type][id], __ATOMIC_RELAXED) & GE_EVENT_MASK(event_type));
+}
+
+/*
+ * Get the event types that are accepted for a device, or for all the devices of a type if id is negative.
+ */
+uint32_t mask_get(GE_DeviceType type, int id);
+
+/*
+ * Check if an event is accepted for the device it comes from.
+ */
+int mask_accepts_event(const GE_Event * event);
+
+/*
+ * Set the event types that are accepted for a device, or for all the devices of a type if id is negative.
+ */
+void mask_set(GE_DeviceType type, int id, uint32_t mask);
+
+void mask_reset();
+
+#endif /* MASK_H_ */
@@ -0,0 +1,154 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <gimxcommon/include/gerror.h>
+#include "names.h"
+
+struct name_entry
+{
+  struct name_entry * next; // the next entry in the bucket
+  unsigned int hash;
+  int * indexes; // the device index for each virtual index, -1 if the virtual index is free
+  int size;
+  int used;
+  char name[];
+};
+
+static unsigned int name_hash(const char * name)
+{
+  // FNV-1a
+  unsigned int hash = 2166136261u;
+  while (*name)
+  {
+    hash ^= (unsigned char) *name++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static struct name_entry * names_find(const struct names * names, const char * name, unsigned int hash)
+{
+  struct name_entry * entry;
+  for (entry = names->buckets[hash & (NAMES_BUCKETS - 1)]; entry != NULL; entry = entry->next)
+  {
+    if (entry->hash == hash && !strcmp(entry->name, name))
+    {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+const char * names_add(struct names * names, const char * name, int index, int * virtual_index)
+{
+  unsigned int hash = name_hash(name);
+
+  struct name_entry * entry = names_find(names, name, hash);
+  if (entry == NULL)
+  {
+    size_t length = strlen(name);
+    entry = calloc(1, sizeof(*entry) + length + 1);
+    if (entry == NULL)
+    {
+      PRINT_ERROR_ALLOC_FAILED("calloc");
+      return NULL;
+    }
+    memcpy(entry->name, name, length + 1);
+    entry->hash = hash;
+    entry->next = names->buckets[hash & (NAMES_BUCKETS - 1)];
+    names->buckets[hash & (NAMES_BUCKETS - 1)] = entry;
+  }
+
+  int i;
+  for (i = 0; i < entry->size && entry->indexes[i] >= 0; ++i) ;
+
+  if (i == entry->size)
+  {
+    int size = entry->size ? 2 * entry->size : 4;
+    int * indexes = realloc(entry->indexes, size * sizeof(*indexes));
+    if (indexes == NULL)
+    {
+      PRINT_ERROR_ALLOC_FAILED("realloc");
+      if (entry->used == 0)
+      {
+        names_remove(names, entry->name, -1);
+      }
+      return NULL;
+    }
+    memset(indexes + entry->size, 0xff, (size - entry->size) * sizeof(*indexes));
+    entry->indexes = indexes;
+    entry->size = size;
+  }
+
+  entry->indexes[i] = index;
+  ++entry->used;
+
+  *virtual_index = i;
+
+  return entry->name;
+}
+
+void names_remove(struct names * names, const char * name, int virtual_index)
+{
+  unsigned int hash = name_hash(name);
+
+  struct name_entry ** previous = names->buckets + (hash & (NAMES_BUCKETS - 1));
+  while (*previous != NULL && ((*previous)->hash != hash || strcmp((*previous)->name, name)))
+  {
+    previous = &(*previous)->next;
+  }
+
+  struct name_entry * entry = *previous;
+  if (entry == NULL)
+  {
+    return;
+  }
+
+  if (virtual_index >= 0 && virtual_index < entry->size && entry->indexes[virtual_index] >= 0)
+  {
+    entry->indexes[virtual_index] = -1;
+    --entry->used;
+  }
+
+  if (entry->used == 0)
+  {
+    *previous = entry->next;
+    free(entry->indexes);
+    free(entry);
+  }
+}
+
+int names_get_index(const struct names * names, const char * name, int virtual_index)
+{
+  if (name == NULL)
+  {
+    return -1;
+  }
+
+  const struct name_entry * entry = names_find(names, name, name_hash(name));
+  if (entry == NULL || virtual_index < 0 || virtual_index >= entry->size)
+  {
+    return -1;
+  }
+
+  return entry->indexes[virtual_index];
+}
+
+void names_clear(struct names * names)
+{
+  unsigned int i;
+  for (i = 0; i < NAMES_BUCKETS; ++i)
+  {
+    while (names->buckets[i] != NULL)
+    {
+      struct name_entry * entry = names->buckets[i];
+      names->buckets[i] = entry->next;
+      free(entry->indexes);
+      free(entry);
+    }
+  }
+}
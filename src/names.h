@@ -0,0 +1,40 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef NAMES_H_
+#define NAMES_H_
+
+#define NAMES_BUCKETS 256 // a power of two
+
+struct name_entry;
+
+/*
+ * The devices of a given type, by name and virtual index.
+ * Names are interned: all devices with the same name share the same string.
+ */
+struct names
+{
+  struct name_entry * buckets[NAMES_BUCKETS];
+};
+
+/*
+ * Give the lowest free virtual index for a name to a device.
+ * Return the interned name, or NULL in case of error.
+ */
+const char * names_add(struct names * names, const char * name, int index, int * virtual_index);
+
+/*
+ * Free the virtual index of a device. The interned name is freed once no device uses it.
+ */
+void names_remove(struct names * names, const char * name, int virtual_index);
+
+/*
+ * Return the index of the device with a given name and virtual index, or -1 if there is none.
+ */
+int names_get_index(const struct names * names, const char * name, int virtual_index);
+
+void names_clear(struct names * names);
+
+#endif /* NAMES_H_ */
@@ -3,81 +3,205 @@
  License: GPLv3
  */
 
-#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <gimxcommon/include/gerror.h>
+#include "queue.h"
 #include "events.h"
 
-static int debug = 0;
+#define CACHE_LINE_SIZE 64
 
-#define eprintf(...) if(debug) printf(__VA_ARGS__)
+/*
+ * A bounded lock-free ring.
+ *
+ * Counters are free-running and only masked when accessing the elements,
+ * so that head == tail means empty and tail - head == size means full.
+ *
+ * Multiple producers first reserve a slot by moving producer.head forward (CAS),
+ * write the element, then wait for the previous producers to publish their
+ * slots before moving producer.tail forward. The consumer only looks at
+ * producer.tail, so the published elements are always contiguous and can be
+ * copied in at most two memcpy calls.
+ */
+struct queue
+{
+  // read-only after creation
+  unsigned int size;
+  unsigned int mask;
+  unsigned int element_size;
+  int multi_producer;
+  unsigned char * elements;
+  void * allocated;
+  // written by the producer(s)
+  struct
+  {
+    unsigned int head; // next slot to reserve
+    unsigned int tail; // next slot to publish
+  } producer __attribute__((aligned(CACHE_LINE_SIZE)));
+  // written by the consumer
+  struct
+  {
+    unsigned int head; // next slot to read
+  } consumer __attribute__((aligned(CACHE_LINE_SIZE)));
+};
 
-static GE_Event queue[MAX_EVENTS];
-static unsigned char queue_index_first = 0;
-static unsigned char queue_index_last = 0;
+static inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#endif
+}
 
-void queue_init()
+static unsigned int round_up_pow2(unsigned int value)
 {
-  queue_index_first = 0;
-  queue_index_last = 0;
+  unsigned int size = 2;
+  while (size < value && size < (1U << 31))
+  {
+    size <<= 1;
+  }
+  return size;
 }
 
-int queue_push_event(GE_Event* ev)
+struct queue * queue_create(unsigned int capacity, unsigned int element_size, int multi_producer)
 {
-  int ret = -1;
-  eprintf("first: %d last: %d\n", queue_index_first, queue_index_last);
-  if(queue_index_last >= queue_index_first)
+  unsigned int size = round_up_pow2(capacity);
+
+  // malloc does not honor the alignment of the counters, so align manually
+  void * allocated = calloc(1, sizeof(struct queue) + CACHE_LINE_SIZE);
+  if (allocated == NULL)
   {
-    queue[queue_index_last] = *ev;
-    queue_index_last++;
-    queue_index_last%=MAX_EVENTS;
-    if(queue_index_last == queue_index_first)
-    {
-      queue_index_last = MAX_EVENTS-1;
-    }
-    else
-    {
-      ret = 0;
-    }
+    PRINT_ERROR_ALLOC_FAILED("calloc");
+    return NULL;
+  }
+
+  struct queue * queue = (struct queue *) (((uintptr_t) allocated + CACHE_LINE_SIZE - 1) & ~(uintptr_t) (CACHE_LINE_SIZE - 1));
+  queue->allocated = allocated;
+
+  queue->elements = calloc(size, element_size);
+  if (queue->elements == NULL)
+  {
+    PRINT_ERROR_ALLOC_FAILED("calloc");
+    free(allocated);
+    return NULL;
   }
-  else if(queue_index_last+1 < queue_index_first)
+
+  queue->size = size;
+  queue->mask = size - 1;
+  queue->element_size = element_size;
+  queue->multi_producer = multi_producer;
+
+  return queue;
+}
+
+void queue_destroy(struct queue * queue)
+{
+  if (queue != NULL)
   {
-    queue[queue_index_last] = *ev;
-    queue_index_last++;
-    ret = 0;
+    free(queue->elements);
+    free(queue->allocated);
   }
-  eprintf("ret: %d first: %d last: %d\n", ret, queue_index_first, queue_index_last);
-  return ret;
 }
 
-int queue_pop_events(GE_Event *events, int numevents)
+int queue_push(struct queue * queue, const void * element)
 {
-  int i;
-  int j = 0;
-  if(queue_index_first > queue_index_last)
+  unsigned int head = __atomic_load_n(&queue->producer.head, __ATOMIC_RELAXED);
+
+  if (queue->multi_producer)
   {
-    for(i=queue_index_first; i<MAX_EVENTS; ++i)
+    do
     {
-      eprintf("peep: %d\n", i);
-      events[j] = queue[i];
-      ++queue_index_first;
-      queue_index_first%=MAX_EVENTS;
-      ++j;
-      if(j == numevents)
+      if (head - __atomic_load_n(&queue->consumer.head, __ATOMIC_ACQUIRE) >= queue->size)
       {
-        return numevents;
+        return -1;
       }
+    } while (!__atomic_compare_exchange_n(&queue->producer.head, &head, head + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  }
+  else
+  {
+    if (head - __atomic_load_n(&queue->consumer.head, __ATOMIC_ACQUIRE) >= queue->size)
+    {
+      return -1;
+    }
+    queue->producer.head = head + 1;
+  }
+
+  memcpy(queue->elements + (head & queue->mask) * queue->element_size, element, queue->element_size);
+
+  if (queue->multi_producer)
+  {
+    // publish in reservation order
+    while (__atomic_load_n(&queue->producer.tail, __ATOMIC_RELAXED) != head)
+    {
+      cpu_relax();
     }
   }
-  for(i=queue_index_first; i<queue_index_last; ++i)
+
+  __atomic_store_n(&queue->producer.tail, head + 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+unsigned int queue_pop(struct queue * queue, void * elements, unsigned int count)
+{
+  unsigned int head = queue->consumer.head;
+  unsigned int available = __atomic_load_n(&queue->producer.tail, __ATOMIC_ACQUIRE) - head;
+
+  if (count > available)
   {
-    eprintf("peep: %d\n", i);
-    events[j] = queue[i];
-    ++queue_index_first;
-    queue_index_first%=MAX_EVENTS;
-    ++j;
-    if(j == numevents)
+    count = available;
+  }
+
+  if (count > 0)
+  {
+    unsigned int first = head & queue->mask;
+    unsigned int span = queue->size - first;
+    if (span > count)
+    {
+      span = count;
+    }
+    memcpy(elements, queue->elements + first * queue->element_size, span * queue->element_size);
+    if (span < count)
     {
-      return numevents;
+      memcpy((unsigned char *) elements + span * queue->element_size, queue->elements, (count - span) * queue->element_size);
     }
+    __atomic_store_n(&queue->consumer.head, head + count, __ATOMIC_RELEASE);
+  }
+
+  return count;
+}
+
+static struct queue * event_queue = NULL;
+
+int queue_init(unsigned int capacity, int multi_producer)
+{
+  queue_quit();
+
+  event_queue = queue_create(capacity ? capacity : MAX_EVENTS, sizeof(GE_Event), multi_producer);
+
+  return event_queue != NULL ? 0 : -1;
+}
+
+void queue_quit()
+{
+  queue_destroy(event_queue);
+  event_queue = NULL;
+}
+
+int queue_push_event(GE_Event* ev)
+{
+  if (event_queue == NULL)
+  {
+    return -1;
+  }
+  return queue_push(event_queue, ev);
+}
+
+int queue_pop_events(GE_Event *events, int numevents)
+{
+  if (event_queue == NULL || numevents <= 0)
+  {
+    return 0;
   }
-  return j;
+  return queue_pop(event_queue, events, numevents);
 }
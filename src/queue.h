@@ -8,7 +8,22 @@
 
 #include <ginput.h>
 
-void queue_init();
+struct queue;
+
+/*
+ * Lock-free ring with a power-of-two capacity (rounded up), one consumer,
+ * and either one producer or multiple producers.
+ */
+struct queue * queue_create(unsigned int capacity, unsigned int element_size, int multi_producer);
+void queue_destroy(struct queue * queue);
+int queue_push(struct queue * queue, const void * element);
+unsigned int queue_pop(struct queue * queue, void * elements, unsigned int count);
+
+/*
+ * The event queue used by ginput_queue_push and ginput_queue_pop.
+ */
+int queue_init(unsigned int capacity, int multi_producer);
+void queue_quit();
 int queue_push_event(GE_Event* ev);
 int queue_pop_events(GE_Event *events, int numevents);
 
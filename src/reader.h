@@ -0,0 +1,30 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef READER_H_
+#define READER_H_
+
+#include <ginput.h>
+
+/*
+ * The reader thread (Linux only).
+ *
+ * When enabled, the sources report their events with reader_push, from the reader thread
+ * (or from the application thread for the polled hidinput devices, followed by reader_signal).
+ * The application thread delivers them with reader_dispatch.
+ * With several shards, each shard of the event loop is dispatched by its own reader thread.
+ */
+int reader_configure(const GE_ReaderConfig * config);
+int reader_set_shards(unsigned int shards, int ordered);
+unsigned int reader_get_shards();
+int reader_enabled();
+int reader_start();
+void reader_stop();
+int reader_push(GE_Event * event);
+void reader_signal();
+int reader_get_fd();
+int reader_dispatch(int timeout, int (*deliver)(GE_Event*));
+
+#endif /* READER_H_ */
@@ -0,0 +1,24 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <ginput.h>
+
+/*
+ * The capture replay (Linux only).
+ *
+ * replay_configure wraps the joystick source and the mkb sources, so that ginput_init
+ * creates the devices of the capture instead of opening the real ones. The records are
+ * then played from the event loop, and go through the translation code of the sources.
+ * The HID devices are not opened: the captured ones are created by the joystick source wrapper.
+ */
+int replay_configure(const char * path, GE_ReplayMode mode);
+int replay_enabled();
+int replay_done();
+void replay_quit();
+
+#endif /* REPLAY_H_ */
@@ -65,6 +65,8 @@ static SDL_Window* window = NULL;
 static int sdlInstanceIdToIndex[GE_MAX_DEVICES] = {};
 
 static int js_max_index = 0;
+
+static GE_HatMode hat_mode = GE_HAT_MODE_BUTTONS;
 // Keep tracking of the number of registered joysticks (externally handled) and the
 // number of opened joysticks, so as to be able to close the joystick subsystem
 // and to avoid pumping the SDL library events when no joystick is used.
@@ -842,9 +844,18 @@ static int sdl_peep_events(GE_Event* events, int size) {
         j += convert_s2g(sdl_events + i, events + j, size - j);
     }
 
+    if (hat_mode == GE_HAT_MODE_NATIVE) {
+        return j;
+    }
+
     return hats_to_buttons(events, j);
 }
 
+static void sdlinput_set_hat_mode(GE_HatMode mode) {
+
+    hat_mode = mode;
+}
+
 static int sdlinput_joystick_get_haptic(int joystick) {
 
     if (joystick < 0 || joystick >= js_max_index || indexToJoystick[joystick] == NULL) {
@@ -1011,8 +1022,21 @@ static struct js_source sdl_js_source = {
     .get_haptic = sdlinput_joystick_get_haptic,
     .set_haptic = sdlinput_joystick_set_haptic,
     .get_hid = NULL,
+    .get_stats = NULL,
+    .get_overflows = NULL,
     .get_usb_ids = sdlinput_joystick_get_usb_ids,
     .close = sdlinput_joystick_close,
+    .remove = NULL,
+    .set_hat_mode = sdlinput_set_hat_mode,
+    .set_haptic_rate = NULL,
+    .set_backend = NULL,
+    .set_hotplug = NULL,
+    .update_event_masks = NULL,
+    .open = NULL,
+    .init_capture = NULL,
+    .open_capture = NULL,
+    .process_capture = NULL,
+    .close_capture = NULL,
     .sync_process = sdlinput_sync_process,
     .quit = sdlinput_js_quit,
 };
@@ -1023,6 +1047,18 @@ static struct mkb_source sdl_mkb_source = {
     .grab = sdlinput_grab,
     .get_mouse_name = sdlinput_mouse_name,
     .get_keyboard_name = sdlinput_keyboard_name,
+    .get_mouse_stats = NULL,
+    .get_keyboard_stats = NULL,
+    .get_mouse_overflows = NULL,
+    .get_keyboard_overflows = NULL,
+    .set_motion_mode = NULL,
+    .set_hotplug = NULL,
+    .update_event_masks = NULL,
+    .open = NULL,
+    .init_capture = NULL,
+    .open_capture = NULL,
+    .process_capture = NULL,
+    .close_capture = NULL,
     .sync_process = sdlinput_sync_process,
     .quit = sdlinput_mkb_quit,
 };
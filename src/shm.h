@@ -0,0 +1,22 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef SHM_H_
+#define SHM_H_
+
+#include <ginput.h>
+
+/*
+ * The shared-memory event ring (Linux only).
+ *
+ * shm_init creates the ring and returns its file descriptor. Once created,
+ * dispatch_event publishes every event with shm_publish, from any thread.
+ */
+int shm_init(unsigned int capacity);
+int shm_enabled();
+void shm_publish(const GE_Event * event, gtime timestamp);
+void shm_quit();
+
+#endif /* SHM_H_ */
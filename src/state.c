@@ -0,0 +1,160 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <string.h>
+#include "state.h"
+
+/*
+ * Each state is protected by a sequence counter (seqlock): the writer makes it odd while it
+ * updates the state, and a reader retries its copy until the counter is even and unchanged.
+ * Each device has a single writer (the thread that dispatches its events), so that the writer
+ * never waits, and readers never block it.
+ */
+
+static struct
+{
+  uint32_t seq;
+  GE_JoystickState state;
+} joysticks[GE_MAX_DEVICES];
+
+static struct
+{
+  uint32_t seq;
+  GE_MouseState state;
+} mice[GE_MAX_DEVICES];
+
+static struct
+{
+  uint32_t seq;
+  GE_KeyboardState state;
+} keyboards[GE_MAX_DEVICES];
+
+static inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static inline void write_begin(uint32_t * seq)
+{
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_end(uint32_t * seq)
+{
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static void read_state(const uint32_t * seq, const void * src, void * dst, size_t size)
+{
+  uint32_t before, after;
+  do
+  {
+    while ((before = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1)
+    {
+      cpu_relax();
+    }
+    memcpy(dst, src, size);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(seq, __ATOMIC_RELAXED);
+  } while (before != after);
+}
+
+#define UPDATE(DEVICES, INDEX, TIMESTAMP, STATEMENT) \
+  do \
+  { \
+    write_begin(&DEVICES[INDEX].seq); \
+    STATEMENT; \
+    DEVICES[INDEX].state.timestamp = TIMESTAMP; \
+    write_end(&DEVICES[INDEX].seq); \
+  } while (0)
+
+#define RESET(DEVICES, INDEX) UPDATE(DEVICES, INDEX, 0, memset(&DEVICES[INDEX].state, 0x00, sizeof(DEVICES[INDEX].state)))
+
+void state_update(const GE_Event * event, gtime timestamp)
+{
+  unsigned int id = event->which; // always lower than GE_MAX_DEVICES
+
+  switch (event->type)
+  {
+    case GE_JOYAXISMOTION:
+      UPDATE(joysticks, id, timestamp, joysticks[id].state.axes[event->jaxis.axis] = event->jaxis.value);
+      break;
+    case GE_JOYBUTTONDOWN:
+    case GE_JOYBUTTONUP:
+      UPDATE(joysticks, id, timestamp, joysticks[id].state.buttons[event->jbutton.button] = (event->type == GE_JOYBUTTONDOWN));
+      break;
+    case GE_JOYHATMOTION:
+      UPDATE(joysticks, id, timestamp, joysticks[id].state.hats[event->jhat.hat] = event->jhat.value);
+      break;
+    case GE_MOUSEMOTION:
+      UPDATE(mice, id, timestamp, mice[id].state.x += event->motion.xrel; mice[id].state.y += event->motion.yrel);
+      break;
+    case GE_MOUSEBUTTONDOWN:
+    case GE_MOUSEBUTTONUP:
+      if (event->button.button < GE_MOUSE_BUTTONS_MAX)
+      {
+        UPDATE(mice, id, timestamp, mice[id].state.buttons[event->button.button] = (event->type == GE_MOUSEBUTTONDOWN));
+      }
+      break;
+    case GE_KEYDOWN:
+    case GE_KEYUP:
+      if (event->key.keysym < GE_KEYS_MAX)
+      {
+        UPDATE(keyboards, id, timestamp, keyboards[id].state.keys[event->key.keysym] = (event->type == GE_KEYDOWN));
+      }
+      break;
+    case GE_JOYDEVICEADDED:
+    case GE_JOYDEVICEREMOVED:
+      RESET(joysticks, id);
+      break;
+    case GE_MOUSEDEVICEADDED:
+    case GE_MOUSEDEVICEREMOVED:
+      RESET(mice, id);
+      break;
+    case GE_KEYBOARDDEVICEADDED:
+    case GE_KEYBOARDDEVICEREMOVED:
+      RESET(keyboards, id);
+      break;
+    default:
+      break;
+  }
+}
+
+int state_get(GE_DeviceType type, int id, void * state)
+{
+  if (id < 0 || id >= GE_MAX_DEVICES || state == NULL)
+  {
+    return -1;
+  }
+
+  switch (type)
+  {
+    case GE_DEVICE_JOYSTICK:
+      read_state(&joysticks[id].seq, &joysticks[id].state, state, sizeof(joysticks[id].state));
+      return 0;
+    case GE_DEVICE_MOUSE:
+      read_state(&mice[id].seq, &mice[id].state, state, sizeof(mice[id].state));
+      return 0;
+    case GE_DEVICE_KEYBOARD:
+      read_state(&keyboards[id].seq, &keyboards[id].state, state, sizeof(keyboards[id].state));
+      return 0;
+  }
+
+  return -1;
+}
+
+void state_reset()
+{
+  int i;
+  for (i = 0; i < GE_MAX_DEVICES; ++i)
+  {
+    RESET(joysticks, i);
+    RESET(mice, i);
+    RESET(keyboards, i);
+  }
+}
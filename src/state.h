@@ -0,0 +1,18 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef STATE_H_
+#define STATE_H_
+
+#include <ginput.h>
+
+/*
+ * The current state of each device, built from the dispatched events.
+ */
+void state_update(const GE_Event * event, gtime timestamp);
+int state_get(GE_DeviceType type, int id, void * state);
+void state_reset();
+
+#endif
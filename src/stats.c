@@ -0,0 +1,55 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include "stats.h"
+
+void stats_copy(GE_Stats * dst, const GE_Stats * src)
+{
+  // all the fields are 64-bit counters
+  const uint64_t * from = (const uint64_t *) src;
+  uint64_t * to = (uint64_t *) dst;
+  unsigned int i;
+  for (i = 0; i < sizeof(*src) / sizeof(*from); ++i)
+  {
+    to[i] = __atomic_load_n(from + i, __ATOMIC_RELAXED);
+  }
+}
+
+static uint64_t bucket_value(unsigned int bucket)
+{
+  if (bucket < 16)
+  {
+    return bucket;
+  }
+  unsigned int exponent = (bucket - 16) / 8 + 4;
+  return (uint64_t) (8 + (bucket - 16) % 8) << (exponent - 3);
+}
+
+uint64_t ginput_histogram_percentile(const GE_Histogram * histogram, double percentile)
+{
+  if (histogram->count == 0)
+  {
+    return 0;
+  }
+
+  uint64_t target = histogram->count * percentile / 100;
+  if (target >= histogram->count)
+  {
+    target = histogram->count - 1;
+  }
+
+  uint64_t seen = 0;
+  unsigned int bucket;
+  for (bucket = 0; bucket < GE_HISTOGRAM_BUCKETS; ++bucket)
+  {
+    seen += histogram->buckets[bucket];
+    if (seen > target)
+    {
+      return bucket_value(bucket);
+    }
+  }
+
+  return histogram->max;
+}
@@ -0,0 +1,80 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <ginput.h>
+
+/*
+ * Per-device statistics, only compiled in with -DGINPUT_STATS (make STATS=1).
+ *
+ * Each device has a single writer (the thread that reads it), so that counters are updated
+ * with relaxed atomic stores and no read-modify-write. ginput_get_stats can copy them from
+ * any thread.
+ */
+
+void stats_copy(GE_Stats * dst, const GE_Stats * src);
+
+#ifdef GINPUT_STATS
+
+#define STATS_ENABLED 1
+
+static inline void stats_add(uint64_t * counter, uint64_t value)
+{
+  __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static inline unsigned int stats_bucket(uint64_t value)
+{
+  if (value < 16)
+  {
+    return value;
+  }
+  unsigned int exponent = 63 - __builtin_clzll(value);
+  return 16 + (exponent - 4) * 8 + ((value >> (exponent - 3)) & 7);
+}
+
+static inline void stats_record(GE_Histogram * histogram, uint64_t value)
+{
+  stats_add(histogram->buckets + stats_bucket(value), 1);
+  stats_add(&histogram->count, 1);
+  stats_add(&histogram->sum, value);
+  if (value > histogram->max)
+  {
+    __atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+  }
+}
+
+static inline void stats_read(GE_Stats * stats, unsigned int records)
+{
+  stats_add(&stats->reads, 1);
+  stats_add(&stats->inputs, records);
+  stats_record(&stats->read_size, records);
+}
+
+#define STATS_FIELD GE_Stats stats;
+#define STATS_READ(DEVICE, RECORDS) stats_read(&(DEVICE)->stats, RECORDS)
+#define STATS_EAGAIN(DEVICE) stats_add(&(DEVICE)->stats.eagain, 1)
+#define STATS_EVENT_TO_READ(DEVICE, EVENT_TIME, READ_TIME) \
+  stats_record(&(DEVICE)->stats.event_to_read, (READ_TIME) > (EVENT_TIME) ? (READ_TIME) - (EVENT_TIME) : 0)
+#define STATS_READ_TO_CALLBACK(DEVICE, READ_TIME) \
+  stats_record(&(DEVICE)->stats.read_to_callback, gtime_gettime() - (READ_TIME))
+#define STATS_GET(DEVICE, STATS) (stats_copy(STATS, &(DEVICE)->stats), 0)
+
+#else
+
+#define STATS_ENABLED 0
+
+#define STATS_FIELD
+#define STATS_READ(DEVICE, RECORDS) do { } while (0)
+#define STATS_EAGAIN(DEVICE) do { } while (0)
+#define STATS_EVENT_TO_READ(DEVICE, EVENT_TIME, READ_TIME) do { } while (0)
+#define STATS_READ_TO_CALLBACK(DEVICE, READ_TIME) do { } while (0)
+#define STATS_GET(DEVICE, STATS) ((void) (DEVICE), (void) (STATS), -1)
+
+#endif
+
+#endif /* STATS_H_ */
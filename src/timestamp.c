@@ -0,0 +1,18 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include "timestamp.h"
+
+static __thread gtime current = 0;
+
+void timestamp_set(gtime timestamp)
+{
+  current = timestamp;
+}
+
+gtime timestamp_get()
+{
+  return current;
+}
@@ -0,0 +1,19 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef TIMESTAMP_H_
+#define TIMESTAMP_H_
+
+#include <gimxtime/include/gtime.h>
+
+/*
+ * Sources call timestamp_set before reporting events, with the time at which the events were generated,
+ * or the time at which they were read if the device does not provide it (gtime_gettime() time base).
+ * The value is thread-local, so that devices can be read from several threads.
+ */
+void timestamp_set(gtime timestamp);
+gtime timestamp_get();
+
+#endif /* TIMESTAMP_H_ */
@@ -204,6 +204,26 @@ void ev_joystick_close(int id)
   jsource->close(id);
 }
 
+void ev_joystick_remove(int id)
+{
+  CHECK_JS_SOURCE();
+
+  if (jsource->remove != NULL)
+  {
+    jsource->remove(id);
+  }
+  else
+  {
+    jsource->close(id);
+  }
+}
+
+int ev_hotplug_init(const GPOLL_INTERFACE * poll_interface __attribute__((unused)))
+{
+  PRINT_ERROR_OTHER("hotplug is not available on this platform");
+  return -1;
+}
+
 const char* ev_mouse_name(int id)
 {
   CHECK_MKB_SOURCE(NULL);
@@ -218,6 +238,46 @@ const char* ev_keyboard_name(int id)
   return mkbsource->get_keyboard_name(id);
 }
 
+void ev_set_motion_mode(GE_MotionMode mode)
+{
+  if (source_physical != NULL && source_physical->set_motion_mode != NULL)
+  {
+    source_physical->set_motion_mode(mode);
+  }
+  if (source_window != NULL && source_window->set_motion_mode != NULL)
+  {
+    source_window->set_motion_mode(mode);
+  }
+}
+
+void ev_set_hat_mode(GE_HatMode mode)
+{
+  if (jsource != NULL && jsource->set_hat_mode != NULL)
+  {
+    jsource->set_hat_mode(mode);
+  }
+}
+
+void ev_set_haptic_rate(unsigned int rate)
+{
+  if (jsource != NULL && jsource->set_haptic_rate != NULL)
+  {
+    jsource->set_haptic_rate(rate);
+  }
+}
+
+void ev_update_event_masks()
+{
+  if (jsource != NULL && jsource->update_event_masks != NULL)
+  {
+    jsource->update_event_masks();
+  }
+  if (mkbsource != NULL && mkbsource->update_event_masks != NULL)
+  {
+    mkbsource->update_event_masks();
+  }
+}
+
 static int is_clipped()
 {
   if (capture.hwnd == NULL)
@@ -277,6 +337,60 @@ static void unclip()
   while(i > 0 && ShowCursor(TRUE) < 0) { i--; }
 }
 
+int ev_get_stats(GE_DeviceType type, int id, GE_Stats * stats)
+{
+  switch (type)
+  {
+    case GE_DEVICE_JOYSTICK:
+      if (jsource != NULL && jsource->get_stats != NULL)
+      {
+        return jsource->get_stats(id, stats);
+      }
+      break;
+    case GE_DEVICE_MOUSE:
+      if (mkbsource != NULL && mkbsource->get_mouse_stats != NULL)
+      {
+        return mkbsource->get_mouse_stats(id, stats);
+      }
+      break;
+    case GE_DEVICE_KEYBOARD:
+      if (mkbsource != NULL && mkbsource->get_keyboard_stats != NULL)
+      {
+        return mkbsource->get_keyboard_stats(id, stats);
+      }
+      break;
+  }
+
+  return -1;
+}
+
+int ev_get_overflows(GE_DeviceType type, int id, uint64_t * overflows)
+{
+  switch (type)
+  {
+    case GE_DEVICE_JOYSTICK:
+      if (jsource != NULL && jsource->get_overflows != NULL)
+      {
+        return jsource->get_overflows(id, overflows);
+      }
+      break;
+    case GE_DEVICE_MOUSE:
+      if (mkbsource != NULL && mkbsource->get_mouse_overflows != NULL)
+      {
+        return mkbsource->get_mouse_overflows(id, overflows);
+      }
+      break;
+    case GE_DEVICE_KEYBOARD:
+      if (mkbsource != NULL && mkbsource->get_keyboard_overflows != NULL)
+      {
+        return mkbsource->get_keyboard_overflows(id, overflows);
+      }
+      break;
+  }
+
+  return -1;
+}
+
 int ev_grab_input(int mode)
 {
   CHECK_MKB_SOURCE(0);
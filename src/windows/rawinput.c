@@ -694,6 +694,18 @@ static struct mkb_source rawinput_source = {
     .grab = NULL,
     .get_mouse_name = rawinput_mouse_name,
     .get_keyboard_name = rawinput_keyboard_name,
+    .get_mouse_stats = NULL,
+    .get_keyboard_stats = NULL,
+    .get_mouse_overflows = NULL,
+    .get_keyboard_overflows = NULL,
+    .set_motion_mode = NULL,
+    .set_hotplug = NULL,
+    .update_event_masks = NULL,
+    .open = NULL,
+    .init_capture = NULL,
+    .open_capture = NULL,
+    .process_capture = NULL,
+    .close_capture = NULL,
     .sync_process = rawinput_poll,
     .quit = rawinput_quit,
 };
@@ -0,0 +1,110 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <gimxtime/include/gtime.h>
+
+#include "ginput_event_bench.h"
+
+/*
+ * Headless benchmark for the event translation routines: synthetic js_event structs,
+ * input_event structs and Steam Controller reports are fed to js_process_event,
+ * mkb_process_event and the steamcontroller process routine. No device is needed.
+ * Allocations are counted by wrapping the glibc allocator.
+ */
+
+volatile int bench_sink = 0;
+
+static unsigned long long allocations = 0;
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t nmemb, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+
+void * malloc(size_t size) {
+  ++allocations;
+  return __libc_malloc(size);
+}
+
+void * calloc(size_t nmemb, size_t size) {
+  ++allocations;
+  return __libc_calloc(nmemb, size);
+}
+
+void * realloc(void * ptr, size_t size) {
+  ++allocations;
+  return __libc_realloc(ptr, size);
+}
+
+static unsigned int iterations = 1000000;
+
+static struct {
+  const char * name;
+  void (* run)(unsigned int iterations, s_bench_result * result);
+} benchs[] = {
+  { "js_process_event",         bench_js },
+  { "js_process_evdev_event",   bench_js_evdev },
+  { "mkb_process_event",        bench_mkb },
+  { "steamcontroller process",  bench_steamcontroller },
+};
+
+static void usage() {
+  fprintf(stderr, "Usage: ./ginput_event_bench [-n iterations]\n");
+  exit(EXIT_FAILURE);
+}
+
+static int read_args(int argc, char* argv[]) {
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+    case 'n':
+      iterations = atoi(optarg);
+      break;
+    default: /* '?' */
+      usage();
+      break;
+    }
+  }
+  if (iterations == 0) {
+    usage();
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+
+  read_args(argc, argv);
+
+  printf("%-24s %12s %12s %10s %10s %14s %12s\n", "routine", "inputs", "events", "ns/input", "ns/event", "events/s", "allocations");
+
+  unsigned int i;
+  for (i = 0; i < sizeof(benchs) / sizeof(*benchs); ++i) {
+
+    s_bench_result result = { };
+
+    // warm up
+    benchs[i].run(iterations / 10 + 1, &result);
+
+    unsigned long long allocations_before = allocations;
+    gtime begin = gtime_gettime();
+
+    benchs[i].run(iterations, &result);
+
+    gtime end = gtime_gettime();
+    unsigned long long allocated = allocations - allocations_before;
+
+    double elapsed = end - begin;
+
+    printf("%-24s %12llu %12llu %10.2f %10.2f %14.0f %12llu\n", benchs[i].name, result.inputs, result.events,
+        elapsed / result.inputs, result.events ? elapsed / result.events : 0.0,
+        elapsed > 0 ? result.events * 1000000000.0 / elapsed : 0.0, allocated);
+  }
+
+  return 0;
+}
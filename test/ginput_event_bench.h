@@ -0,0 +1,26 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#ifndef GINPUT_EVENT_BENCH_H_
+#define GINPUT_EVENT_BENCH_H_
+
+/*
+ * Each benchmark feeds synthetic input through a translation routine, and reports
+ * the number of inputs (js_event, input_event or HID reports) and generated events.
+ */
+typedef struct {
+  unsigned long long inputs;
+  unsigned long long events;
+} s_bench_result;
+
+void bench_js(unsigned int iterations, s_bench_result * result);
+void bench_js_evdev(unsigned int iterations, s_bench_result * result);
+void bench_mkb(unsigned int iterations, s_bench_result * result);
+void bench_steamcontroller(unsigned int iterations, s_bench_result * result);
+
+// written by the event callbacks, so that the translation can't be optimized away
+extern volatile int bench_sink;
+
+#endif /* GINPUT_EVENT_BENCH_H_ */
@@ -0,0 +1,115 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+/*
+ * The translation routine is static, so the source file is included.
+ */
+#include "../src/linux/js.c"
+
+#include "ginput_event_bench.h"
+
+static unsigned long long bench_events = 0;
+
+static int bench_callback(GE_Event * event) {
+
+    ++bench_events;
+    bench_sink ^= event->jaxis.value;
+    return 0;
+}
+
+void bench_js(unsigned int iterations, s_bench_result * result) {
+
+    struct joystick_device device = { .id = 0, .fd = -1, .node = -1, .name = "bench", .force_feedback = { .fd = -1 } };
+
+    // 6 axes, then a hat, then 12 buttons
+    uint8_t axes[AXMAP_SIZE] = { ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ, ABS_HAT0X, ABS_HAT0Y };
+    js_compile_axes(&device, axes, 12);
+
+    static const struct js_event je[] = {
+        { .type = JS_EVENT_AXIS,   .number = 0, .value = 1200 },
+        { .type = JS_EVENT_AXIS,   .number = 1, .value = -3400 },
+        { .type = JS_EVENT_AXIS,   .number = 3, .value = 5600 },
+        { .type = JS_EVENT_AXIS,   .number = 4, .value = -7800 },
+        { .type = JS_EVENT_AXIS,   .number = 2, .value = 32767 },
+        { .type = JS_EVENT_AXIS,   .number = 5, .value = -32767 },
+        { .type = JS_EVENT_BUTTON, .number = 0, .value = 1 },
+        { .type = JS_EVENT_BUTTON, .number = 0, .value = 0 },
+        { .type = JS_EVENT_AXIS,   .number = 6, .value = 32767 },
+        { .type = JS_EVENT_AXIS,   .number = 6, .value = 0 },
+        { .type = JS_EVENT_AXIS,   .number = 7, .value = -32767 },
+        { .type = JS_EVENT_AXIS,   .number = 7, .value = 0 },
+    };
+
+    event_callback = bench_callback;
+    bench_events = 0;
+
+    unsigned int i, j;
+    for (i = 0; i < iterations; ++i) {
+        for (j = 0; j < sizeof(je) / sizeof(*je); ++j) {
+            js_process_event(&device, (struct js_event *) je + j);
+        }
+    }
+
+    result->inputs = (unsigned long long) iterations * (sizeof(je) / sizeof(*je));
+    result->events = bench_events;
+}
+
+void bench_js_evdev(unsigned int iterations, s_bench_result * result) {
+
+    struct joystick_device device = { .id = 0, .fd = -1, .node = -1, .name = "bench", .force_feedback = { .fd = -1 } };
+
+    static struct evdev_map map;
+    memset(map.abs, 0xff, sizeof(map.abs));
+    memset(map.buttons, 0xff, sizeof(map.buttons));
+    memset(map.keys, 0x00, sizeof(map.keys));
+    map.dropped = 0;
+    device.evdev = &map;
+
+    // 6 axes in [0, 255], then a hat, then 12 buttons
+    uint8_t axes[AXMAP_SIZE] = { ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ, ABS_HAT0X, ABS_HAT0Y };
+    js_compile_axes(&device, axes, 12);
+    unsigned int i;
+    for (i = 0; i < 8; ++i) {
+        map.abs[axes[i]].number = i;
+        map.abs[axes[i]].minimum = (i < 6) ? 0 : -1;
+        map.abs[axes[i]].scale = (65534LL << 16) / ((i < 6) ? 255 : 2);
+        map.abs[axes[i]].value = 0;
+    }
+    for (i = 0; i < 12; ++i) {
+        map.buttons[BTN_TRIGGER + i - BTN_MISC] = i;
+    }
+
+    static const struct input_event ie[] = {
+        { .type = EV_ABS, .code = ABS_X,     .value = 140 },
+        { .type = EV_ABS, .code = ABS_Y,     .value = 100 },
+        { .type = EV_ABS, .code = ABS_RX,    .value = 150 },
+        { .type = EV_ABS, .code = ABS_RY,    .value = 90 },
+        { .type = EV_ABS, .code = ABS_Z,     .value = 255 },
+        { .type = EV_ABS, .code = ABS_RZ,    .value = 0 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+        { .type = EV_KEY, .code = BTN_TRIGGER, .value = 1 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+        { .type = EV_KEY, .code = BTN_TRIGGER, .value = 0 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+        { .type = EV_ABS, .code = ABS_HAT0X, .value = 1 },
+        { .type = EV_ABS, .code = ABS_HAT0X, .value = 0 },
+        { .type = EV_ABS, .code = ABS_HAT0Y, .value = -1 },
+        { .type = EV_ABS, .code = ABS_HAT0Y, .value = 0 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+    };
+
+    event_callback = bench_callback;
+    bench_events = 0;
+
+    unsigned int j;
+    for (i = 0; i < iterations; ++i) {
+        for (j = 0; j < sizeof(ie) / sizeof(*ie); ++j) {
+            js_process_evdev_event(&device, (struct input_event *) ie + j);
+        }
+    }
+
+    result->inputs = (unsigned long long) iterations * (sizeof(ie) / sizeof(*ie));
+    result->events = bench_events;
+}
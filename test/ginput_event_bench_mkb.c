@@ -0,0 +1,64 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+/*
+ * The translation routine is static, so the source file is included.
+ */
+#include "../src/linux/mkb.c"
+
+#include "ginput_event_bench.h"
+
+static unsigned long long bench_events = 0;
+
+static int bench_callback(GE_Event * event) {
+
+    ++bench_events;
+    bench_sink ^= event->motion.xrel;
+    return 0;
+}
+
+#define MOTION(X, Y) \
+    { .type = EV_REL, .code = REL_X, .value = X }, \
+    { .type = EV_REL, .code = REL_Y, .value = Y }, \
+    { .type = EV_SYN, .code = SYN_REPORT }
+
+void bench_mkb(unsigned int iterations, s_bench_result * result) {
+
+    struct mkb_device device = { .fd = -1, .node = -1, .mouse = 0, .keyboard = 0, .name = "bench" };
+
+    // mostly mouse motion, as with a high polling rate mouse, with a few keys, buttons and wheel steps
+    static const struct input_event ie[] = {
+        MOTION(1, -2), MOTION(3, 0), MOTION(-1, 4), MOTION(2, 2),
+        MOTION(0, -1), MOTION(5, 1), MOTION(-3, -3), MOTION(1, 1),
+        { .type = EV_MSC, .code = MSC_SCAN, .value = 30 },
+        { .type = EV_KEY, .code = KEY_A, .value = 1 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+        { .type = EV_KEY, .code = KEY_A, .value = 2 }, // autorepeat
+        { .type = EV_SYN, .code = SYN_REPORT },
+        { .type = EV_KEY, .code = KEY_A, .value = 0 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+        { .type = EV_KEY, .code = BTN_LEFT, .value = 1 },
+        { .type = EV_REL, .code = REL_X, .value = 2 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+        { .type = EV_KEY, .code = BTN_LEFT, .value = 0 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+        { .type = EV_REL, .code = REL_WHEEL, .value = 1 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+    };
+
+    event_callback = bench_callback;
+    motion_mode = GE_MOTION_FRAME;
+    bench_events = 0;
+
+    unsigned int i, j;
+    for (i = 0; i < iterations; ++i) {
+        for (j = 0; j < sizeof(ie) / sizeof(*ie); ++j) {
+            mkb_process_event(&device, (struct input_event *) ie + j);
+        }
+    }
+
+    result->inputs = (unsigned long long) iterations * (sizeof(ie) / sizeof(*ie));
+    result->events = bench_events;
+}
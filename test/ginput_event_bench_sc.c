@@ -0,0 +1,53 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+/*
+ * The translation routine is static, so the source file is included.
+ */
+#include "../src/hid/steamcontroller.c"
+
+#include "ginput_event_bench.h"
+
+static unsigned long long bench_events = 0;
+
+static int bench_callback(GE_Event * event) {
+
+    ++bench_events;
+    bench_sink ^= event->jaxis.value;
+    return 0;
+}
+
+void bench_steamcontroller(unsigned int iterations, s_bench_result * result) {
+
+    struct hidinput_device_internal device = { .hid = NULL, .joystick = 0 };
+
+    // two reports that differ in a few buttons, a trigger, the stick and the right pad
+    s_sc_report reports[2] = { };
+    reports[0].status = htons(0x013c);
+    reports[0].buttons[0] = 0x01;
+    reports[0].left_trigger = 10;
+    reports[0].left_x = 1000;
+    reports[0].left_y = -2000;
+    reports[0].right_x = 3000;
+    reports[0].right_y = -4000;
+    reports[1] = reports[0];
+    reports[1].buttons[0] = 0x02;
+    reports[1].left_trigger = 200;
+    reports[1].left_x = -1500;
+    reports[1].left_y = 2500;
+    reports[1].right_x = -3500;
+    reports[1].right_y = 4500;
+
+    event_callback = bench_callback;
+    bench_events = 0;
+
+    unsigned int i;
+    for (i = 0; i < iterations; ++i) {
+        process(&device, reports + (i & 1), sizeof(*reports));
+    }
+
+    result->inputs = iterations;
+    result->events = bench_events;
+}
@@ -0,0 +1,154 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <gimxinput/include/ginput.h>
+#include <gimxtime/include/gtime.h>
+
+/*
+ * Contention benchmark for the event queue: several producer threads
+ * call ginput_queue_push while one consumer thread drains the queue
+ * with ginput_queue_pop. Each producer tags its events with its index
+ * and a sequence number, so that the consumer can check that no event
+ * is lost, duplicated or reordered.
+ */
+
+#define MAX_PRODUCERS 16
+#define BATCH_SIZE 64
+
+static unsigned int producers = 1;
+static unsigned int events_per_producer = 1000000;
+static unsigned int queue_size = 256;
+
+static volatile int start = 0;
+
+static struct
+{
+  pthread_t thread;
+  unsigned long long full; // number of times the queue was full
+} producer_info[MAX_PRODUCERS];
+
+static void usage() {
+  fprintf(stderr, "Usage: ./ginput_queue_bench [-p producers] [-n events_per_producer] [-s queue_size]\n");
+  exit(EXIT_FAILURE);
+}
+
+static int read_args(int argc, char* argv[]) {
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:n:s:")) != -1) {
+    switch (opt) {
+    case 'p':
+      producers = atoi(optarg);
+      break;
+    case 'n':
+      events_per_producer = atoi(optarg);
+      break;
+    case 's':
+      queue_size = atoi(optarg);
+      break;
+    default: /* '?' */
+      usage();
+      break;
+    }
+  }
+  if (producers == 0 || producers > MAX_PRODUCERS) {
+    usage();
+  }
+  return 0;
+}
+
+static void * producer(void * arg) {
+
+  unsigned int index = (unsigned long) arg;
+
+  GE_Event event = { .jperiodic = { .type = GE_JOYSINEFORCE, .which = index } };
+
+  while (!start) {
+    sched_yield();
+  }
+
+  unsigned int i;
+  for (i = 0; i < events_per_producer; ++i) {
+    event.jperiodic.sine.direction = i;
+    while (ginput_queue_push(&event) < 0) {
+      ++producer_info[index].full;
+      sched_yield();
+    }
+  }
+
+  return NULL;
+}
+
+int main(int argc, char* argv[]) {
+
+  read_args(argc, argv);
+
+  if (ginput_queue_configure(queue_size, producers > 1 ? GE_QUEUE_MULTI_PRODUCER : GE_QUEUE_SINGLE_PRODUCER) < 0) {
+    exit(-1);
+  }
+
+  unsigned int i;
+  for (i = 0; i < producers; ++i) {
+    if (pthread_create(&producer_info[i].thread, NULL, producer, (void *) (unsigned long) i)) {
+      fprintf(stderr, "failed to create producer thread\n");
+      exit(-1);
+    }
+  }
+
+  int expected[MAX_PRODUCERS] = { };
+  unsigned long long total = (unsigned long long) producers * events_per_producer;
+  unsigned long long received = 0;
+  unsigned long long pops = 0;
+  unsigned long long errors = 0;
+
+  GE_Event events[BATCH_SIZE];
+
+  gtime begin = gtime_gettime();
+
+  start = 1;
+
+  while (received < total) {
+    int nb = ginput_queue_pop(events, BATCH_SIZE);
+    int j;
+    for (j = 0; j < nb; ++j) {
+      unsigned int which = events[j].jperiodic.which;
+      if (which >= producers || events[j].jperiodic.sine.direction != expected[which]) {
+        ++errors;
+      } else {
+        ++expected[which];
+      }
+    }
+    if (nb > 0) {
+      received += nb;
+      ++pops;
+    } else {
+      sched_yield();
+    }
+  }
+
+  gtime end = gtime_gettime();
+
+  unsigned long long full = 0;
+  for (i = 0; i < producers; ++i) {
+    pthread_join(producer_info[i].thread, NULL);
+    full += producer_info[i].full;
+  }
+
+  double elapsed = (end - begin) / 1000000000.0;
+
+  printf("producers: %u, queue size: %u, events: %llu\n", producers, queue_size, total);
+  printf("elapsed: %.3f s, %.1f ns/event, %.0f events/s\n", elapsed, (end - begin) / (double) total, total / elapsed);
+  printf("average batch: %.1f events, queue full: %llu times\n", pops ? (double) received / pops : 0.0, full);
+  printf("ordering errors: %llu\n", errors);
+
+  return errors ? -1 : 0;
+}
@@ -0,0 +1,84 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "../src/loop.h"
+
+/*
+ * Check that the callbacks run by the internal event loop can call the library.
+ * The application calls (e.g. ginput_grab_toggle from the event callback) take the loop lock,
+ * that the loop already holds for writing when it runs the callback:
+ * - with a single shard, for all the callbacks,
+ * - with several shards, for the exclusive sources.
+ * A pipe stands in for a device, and a deadlock is reported by the default SIGALRM action.
+ */
+
+static int fds[2];
+static unsigned int calls = 0;
+
+static int process(void * user __attribute__((unused))) {
+  char c;
+  while (read(fds[0], &c, sizeof(c)) > 0) ;
+  // as LOCK_SOURCES does in the library functions, twice for a nested call
+  loop_lock();
+  loop_lock();
+  loop_unlock();
+  loop_unlock();
+  ++calls;
+  return 0;
+}
+
+static int check(unsigned int shards, const GPOLL_INTERFACE * poll_interface, const char * name) {
+
+  if (pipe(fds) < 0 || fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0 || loop_init(shards) < 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  GPOLL_CALLBACKS callbacks = { .fp_read = process, .fp_write = NULL, .fp_close = NULL };
+  if (poll_interface->fp_register(fds[0], NULL, &callbacks) < 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  calls = 0;
+
+  alarm(5);
+  unsigned int i;
+  for (i = 0; i < 10; ++i) {
+    if (write(fds[1], "x", 1) != 1) {
+      exit(EXIT_FAILURE);
+    }
+    unsigned int shard;
+    for (shard = 0; shard < shards; ++shard) {
+      loop_dispatch_shard(shard, 0);
+    }
+  }
+  // the lock has to be released once the callbacks are done
+  loop_lock();
+  loop_unlock();
+  alarm(0);
+
+  poll_interface->fp_remove(fds[0]);
+  loop_quit();
+  close(fds[0]);
+  close(fds[1]);
+
+  printf("%-30s %s\n", name, calls == 10 ? "ok" : "failed");
+
+  return calls == 10 ? 0 : -1;
+}
+
+int main() {
+
+  int ret = 0;
+
+  ret |= check(1, &loop_interface, "single shard");
+  ret |= check(2, &loop_interface_exclusive, "exclusive source, 2 shards");
+
+  return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -67,7 +67,7 @@ int process_event2(GE_Event* event __attribute__((unused))) {
 }
 
 static void usage() {
-  fprintf(stderr, "Usage: ./ginput_test [-d] [-n period_count] [-p] [-q]\n");
+  fprintf(stderr, "Usage: ./ginput_test [-d] [-e] [-h] [-n period_count] [-p] [-q]\n");
   exit(EXIT_FAILURE);
 }
 
@@ -76,6 +76,8 @@ static int quiet = 0;
 static int debug = 0;
 static int prio = 0;
 static int perf = 0;
+static int hotplug = 0;
+static int internal_loop = 0;
 
 /*
  * Reads command-line arguments.
@@ -83,11 +85,17 @@ static int perf = 0;
 static int read_args(int argc, char* argv[]) {
 
   int opt;
-  while ((opt = getopt(argc, argv, "dn:pqs")) != -1) {
+  while ((opt = getopt(argc, argv, "dehn:pqs")) != -1) {
     switch (opt) {
     case 'd':
       debug = 1;
       break;
+    case 'e':
+      internal_loop = 1;
+      break;
+    case 'h':
+      hotplug = 1;
+      break;
     case 'n':
       periods = atoi(optarg);
       break;
@@ -108,6 +116,22 @@ static int read_args(int argc, char* argv[]) {
   return 0;
 }
 
+#ifndef WIN32
+/*
+ * The internal event loop of the library is nested into gpoll, so that the timer keeps working.
+ */
+static int dispatch_read(void * user __attribute__((unused))) {
+
+  return ginput_dispatch(0) < 0;
+}
+
+static int dispatch_close(void * user __attribute__((unused))) {
+
+  set_done();
+  return 1;
+}
+#endif
+
 int main(int argc __attribute__((unused)), char* argv[] __attribute__((unused)))
 {
   setup_handlers();
@@ -126,15 +150,35 @@ int main(int argc __attribute__((unused)), char* argv[] __attribute__((unused)))
     exit(-1);
   }
 
+  if (hotplug && ginput_set_hotplug(1) < 0)
+  {
+    exit(-1);
+  }
+
   GPOLL_INTERFACE poll_interface = {
           .fp_register = REGISTER_FUNCTION,
           .fp_remove = REMOVE_FUNCTION
   };
-  if (ginput_init(&poll_interface, mkb_source, quiet ? process_event2 : process_event) < 0)
+  if (ginput_init(internal_loop ? NULL : &poll_interface, mkb_source, quiet ? process_event2 : process_event) < 0)
   {
     exit(-1);
   }
 
+#ifndef WIN32
+  if (internal_loop)
+  {
+    GPOLL_CALLBACKS callbacks = {
+            .fp_read = dispatch_read,
+            .fp_write = NULL,
+            .fp_close = dispatch_close,
+    };
+    if (REGISTER_FUNCTION(ginput_get_fd(), NULL, &callbacks) < 0)
+    {
+      exit(-1);
+    }
+  }
+#endif
+
   display_devices();
 
   GTIMER_CALLBACKS timer_callbacks = {
@@ -190,6 +234,13 @@ int main(int argc __attribute__((unused)), char* argv[] __attribute__((unused)))
     gtimer_close(timer);
   }
 
+#ifndef WIN32
+  if (internal_loop)
+  {
+    REMOVE_FUNCTION(ginput_get_fd());
+  }
+#endif
+
   ginput_quit();
 
   printf("Exiting\n");
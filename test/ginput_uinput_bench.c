@@ -0,0 +1,493 @@
+/*
+ Copyright (c) 2016 Mathieu Laurendeau <mat.lau@laposte.net>
+ License: GPLv3
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+#include <gimxinput/include/ginput.h>
+
+/*
+ * End-to-end benchmark: virtual devices are created with uinput, and events are injected
+ * at a controlled rate from a thread, while the main thread runs the internal event loop.
+ * The latency is measured from the write to the uinput device until the callback gets
+ * the event, through the kernel, the event loop, and the translation code of the sources.
+ * With -m, the rate is doubled until events are lost or the injection can't keep up,
+ * which gives the max sustainable rate. Needs write access to /dev/uinput and to the event
+ * devices, but no hardware.
+ */
+
+#define BENCH_NAME "gimx uinput bench"
+
+static unsigned int nb_events = 10000;
+static unsigned int rate = 1000; // events per second, 0 for as fast as possible
+static int sweep = 0;
+static const char * types = "mkj";
+static int evdev = 0;
+
+typedef struct {
+  const char * name;
+  GE_DeviceType type;
+  int uinput;
+  int id; // the ginput index
+  int state; // the key or axis state, as the kernel drops the events that don't change it
+  // the step that is running
+  gtime * stamps; // the write times, by event sequence number
+  unsigned int injected;
+  unsigned int delivered;
+  gtime * latencies;
+} s_bench_device;
+
+static s_bench_device devices[] = {
+  { .name = BENCH_NAME " mouse", .type = GE_DEVICE_MOUSE, .uinput = -1, .id = -1 },
+  { .name = BENCH_NAME " keyboard", .type = GE_DEVICE_KEYBOARD, .uinput = -1, .id = -1 },
+  { .name = BENCH_NAME " joystick", .type = GE_DEVICE_JOYSTICK, .uinput = -1, .id = -1 },
+};
+
+#define NB_DEVICES (sizeof(devices) / sizeof(*devices))
+
+static const char type_chars[] = "mkj"; // by device, for -t
+
+static s_bench_device * current = NULL;
+
+static int ioctl_int(int fd, unsigned long request, int value) {
+  if (ioctl(fd, request, value) < 0) {
+    fprintf(stderr, "uinput ioctl failed: %s\n", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static int create_device(s_bench_device * device) {
+
+  int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "can't open /dev/uinput: %s\n", strerror(errno));
+    return -1;
+  }
+
+  struct uinput_user_dev dev = { .id = { .bustype = BUS_VIRTUAL, .vendor = 0x1234, .version = 1 } };
+  snprintf(dev.name, sizeof(dev.name), "%s", device->name);
+
+  int ret = 0;
+  unsigned int i;
+  switch (device->type) {
+  case GE_DEVICE_MOUSE:
+    dev.id.product = 1;
+    ret |= ioctl_int(fd, UI_SET_EVBIT, EV_REL);
+    ret |= ioctl_int(fd, UI_SET_RELBIT, REL_X);
+    ret |= ioctl_int(fd, UI_SET_RELBIT, REL_Y);
+    ret |= ioctl_int(fd, UI_SET_EVBIT, EV_KEY);
+    ret |= ioctl_int(fd, UI_SET_KEYBIT, BTN_LEFT);
+    ret |= ioctl_int(fd, UI_SET_KEYBIT, BTN_RIGHT);
+    break;
+  case GE_DEVICE_KEYBOARD:
+    dev.id.product = 2;
+    ret |= ioctl_int(fd, UI_SET_EVBIT, EV_KEY);
+    for (i = KEY_ESC; i <= KEY_SLASH; ++i) {
+      ret |= ioctl_int(fd, UI_SET_KEYBIT, i);
+    }
+    break;
+  case GE_DEVICE_JOYSTICK:
+    dev.id.product = 3;
+    ret |= ioctl_int(fd, UI_SET_EVBIT, EV_ABS);
+    ret |= ioctl_int(fd, UI_SET_ABSBIT, ABS_X);
+    ret |= ioctl_int(fd, UI_SET_ABSBIT, ABS_Y);
+    dev.absmin[ABS_X] = dev.absmin[ABS_Y] = -32767;
+    dev.absmax[ABS_X] = dev.absmax[ABS_Y] = 32767;
+    ret |= ioctl_int(fd, UI_SET_EVBIT, EV_KEY);
+    for (i = BTN_SOUTH; i <= BTN_START; ++i) {
+      ret |= ioctl_int(fd, UI_SET_KEYBIT, i);
+    }
+    break;
+  }
+
+  if (ret < 0) {
+    close(fd);
+    return -1;
+  }
+
+  if (write(fd, &dev, sizeof(dev)) != (ssize_t) sizeof(dev)) {
+    fprintf(stderr, "can't setup the uinput device: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  if (ioctl_int(fd, UI_DEV_CREATE, 0) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  device->uinput = fd;
+
+  return 0;
+}
+
+static void destroy_device(s_bench_device * device) {
+  if (device->uinput >= 0) {
+    ioctl(device->uinput, UI_DEV_DESTROY);
+    close(device->uinput);
+    device->uinput = -1;
+  }
+}
+
+// a frame that produces exactly one event in the callback
+static void write_frame(s_bench_device * device) {
+
+  struct input_event ie[2] = { { .type = EV_SYN }, { .type = EV_SYN, .code = SYN_REPORT } };
+
+  device->state = !device->state;
+
+  switch (device->type) {
+  case GE_DEVICE_MOUSE:
+    ie[0] = (struct input_event) { .type = EV_REL, .code = REL_X, .value = device->state ? 1 : -1 };
+    break;
+  case GE_DEVICE_KEYBOARD:
+    ie[0] = (struct input_event) { .type = EV_KEY, .code = KEY_A, .value = device->state };
+    break;
+  case GE_DEVICE_JOYSTICK:
+    ie[0] = (struct input_event) { .type = EV_ABS, .code = ABS_X, .value = device->state ? 16384 : -16384 };
+    break;
+  }
+
+  if (write(device->uinput, ie, sizeof(ie)) != (ssize_t) sizeof(ie)) {
+    fprintf(stderr, "can't write to the uinput device: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void inject(s_bench_device * device) {
+
+  __atomic_store_n(device->stamps + device->injected, gtime_gettime(), __ATOMIC_RELEASE);
+
+  // published before the write, so that the event never comes before its stamp
+  __atomic_store_n(&device->injected, device->injected + 1, __ATOMIC_RELEASE);
+
+  write_frame(device);
+}
+
+static unsigned int step_rate = 0;
+static gtime step_begin = 0;
+static gtime step_end = 0; // when the last event was injected
+
+static void * injector(void * arg) {
+
+  s_bench_device * device = (s_bench_device *) arg;
+
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  step_begin = gtime_gettime();
+
+  unsigned int i;
+  for (i = 0; i < nb_events; ++i) {
+    if (step_rate > 0) {
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+      next.tv_nsec += 1000000000L / step_rate;
+      if (next.tv_nsec >= 1000000000L) {
+        next.tv_nsec -= 1000000000L;
+        ++next.tv_sec;
+      }
+    }
+    inject(device);
+  }
+
+  __atomic_store_n(&step_end, gtime_gettime(), __ATOMIC_RELEASE);
+
+  return NULL;
+}
+
+// tell if an event is the one produced by a frame of a device
+static int is_frame_event(const s_bench_device * device, const GE_Event * event) {
+
+  if (device == NULL || event->which != device->id) {
+    return 0;
+  }
+
+  switch (event->type) {
+  case GE_MOUSEMOTION:
+    return device->type == GE_DEVICE_MOUSE;
+  case GE_KEYDOWN:
+  case GE_KEYUP:
+    return device->type == GE_DEVICE_KEYBOARD;
+  case GE_JOYAXISMOTION:
+    return device->type == GE_DEVICE_JOYSTICK && event->jaxis.axis == 0;
+  default:
+    return 0;
+  }
+}
+
+static int process_event(GE_Event * event) {
+
+  gtime now = gtime_gettime();
+
+  s_bench_device * device = current;
+  if (!is_frame_event(device, event)) {
+    return 0;
+  }
+
+  // the events of a device are delivered in order: the n-th event is the n-th injected one
+  if (device->delivered < __atomic_load_n(&device->injected, __ATOMIC_ACQUIRE)) {
+    device->latencies[device->delivered] = now - __atomic_load_n(device->stamps + device->delivered, __ATOMIC_ACQUIRE);
+  }
+  ++device->delivered;
+
+  return 0;
+}
+
+// process the events until none comes for the given time
+static void drain(gtime quiet) {
+  gtime last = gtime_gettime();
+  while (gtime_gettime() - last < quiet) {
+    if (ginput_dispatch(10) > 0) {
+      last = gtime_gettime();
+    }
+  }
+}
+
+static int compare_gtime(const void * a, const void * b) {
+  gtime ga = *(const gtime *) a;
+  gtime gb = *(const gtime *) b;
+  return (ga > gb) - (ga < gb);
+}
+
+static uint64_t get_overflows(s_bench_device * device) {
+  uint64_t overflows = 0;
+  ginput_get_overflows(device->type, device->id, &overflows);
+  return overflows;
+}
+
+/*
+ * Inject nb_events at the given rate, and return 1 if they were all delivered in time.
+ */
+static int bench_step(s_bench_device * device, unsigned int target) {
+
+  device->injected = 0;
+  device->delivered = 0;
+  memset(device->latencies, 0x00, nb_events * sizeof(*device->latencies));
+  step_rate = target;
+  step_end = 0;
+
+  uint64_t overflows = get_overflows(device);
+
+  current = device;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, injector, device) != 0) {
+    fprintf(stderr, "can't create the injection thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // wait until all the events are delivered, or none was for 500ms after the last injection
+  gtime end;
+  while ((end = __atomic_load_n(&step_end, __ATOMIC_ACQUIRE)) == 0
+      || (device->delivered < nb_events && gtime_gettime() - end < 500000000LL)) {
+    ginput_dispatch(10);
+  }
+
+  pthread_join(thread, NULL);
+
+  drain(50000000LL);
+
+  current = NULL;
+
+  overflows = get_overflows(device) - overflows;
+
+  unsigned int lost = (device->delivered < nb_events) ? nb_events - device->delivered : 0;
+  double achieved = (double) nb_events * 1000000000LL / (end - step_begin);
+
+  char rate_str[16] = "max";
+  if (target > 0) {
+    snprintf(rate_str, sizeof(rate_str), "%u", target);
+  }
+
+  printf("%-9s %9s %10.0f %9u %9u %9llu", device->name + sizeof(BENCH_NAME), rate_str, achieved, device->delivered, lost,
+      (unsigned long long) overflows);
+
+  if (device->delivered == nb_events && overflows == 0) {
+    qsort(device->latencies, nb_events, sizeof(*device->latencies), compare_gtime);
+    printf(" %9.1f %9.1f %9.1f\n", device->latencies[nb_events / 2] / 1000.0,
+        device->latencies[nb_events * 99 / 100] / 1000.0, device->latencies[nb_events - 1] / 1000.0);
+  } else {
+    printf(" %9s %9s %9s\n", "-", "-", "-");
+  }
+
+  fflush(stdout);
+
+  return lost == 0 && overflows == 0 && (target == 0 || achieved >= 0.9 * target);
+}
+
+static void bench(s_bench_device * device) {
+
+  device->stamps = calloc(nb_events, sizeof(*device->stamps));
+  device->latencies = calloc(nb_events, sizeof(*device->latencies));
+  if (device->stamps == NULL || device->latencies == NULL) {
+    exit(EXIT_FAILURE);
+  }
+
+  if (!sweep) {
+    bench_step(device, rate);
+  } else {
+    unsigned int target = rate;
+    unsigned int sustained = 0;
+    while (bench_step(device, target)) {
+      sustained = target;
+      if (target > 0x7fffffff) {
+        break;
+      }
+      target *= 2;
+    }
+    if (sustained > 0) {
+      printf("%-9s max sustainable rate: %u events/s\n", device->name + sizeof(BENCH_NAME), sustained);
+    } else {
+      printf("%-9s max sustainable rate: below %u events/s\n", device->name + sizeof(BENCH_NAME), rate);
+    }
+  }
+
+  free(device->stamps);
+  free(device->latencies);
+}
+
+static const char * device_name(GE_DeviceType type, int id) {
+  switch (type) {
+  case GE_DEVICE_MOUSE:
+    return ginput_mouse_name(id);
+  case GE_DEVICE_KEYBOARD:
+    return ginput_keyboard_name(id);
+  case GE_DEVICE_JOYSTICK:
+    return ginput_joystick_name(id);
+  }
+  return NULL;
+}
+
+static int find_device(s_bench_device * device) {
+  int id;
+  for (id = 0; id < GE_MAX_DEVICES; ++id) {
+    const char * name = device_name(device->type, id);
+    if (name != NULL && strcmp(name, device->name) == 0) {
+      device->id = id;
+      return 0;
+    }
+  }
+  fprintf(stderr, "%s was not opened\n", device->name);
+  return -1;
+}
+
+static void usage() {
+  fprintf(stderr, "Usage: ./ginput_uinput_bench [-n events] [-r rate] [-m] [-t mkj] [-e]\n");
+  fprintf(stderr, "  -n: the events injected per step\n");
+  fprintf(stderr, "  -r: the injection rate in events per second, 0 for as fast as possible\n");
+  fprintf(stderr, "  -m: double the rate (> 0) until events are lost, to find the max sustainable rate\n");
+  fprintf(stderr, "  -t: the devices to benchmark: m(ouse), k(eyboard), j(oystick)\n");
+  fprintf(stderr, "  -e: use the evdev joystick backend\n");
+  exit(EXIT_FAILURE);
+}
+
+static int read_args(int argc, char* argv[]) {
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:mt:e")) != -1) {
+    switch (opt) {
+    case 'n':
+      nb_events = atoi(optarg);
+      break;
+    case 'r':
+      rate = atoi(optarg);
+      break;
+    case 'm':
+      sweep = 1;
+      break;
+    case 't':
+      types = optarg;
+      break;
+    case 'e':
+      evdev = 1;
+      break;
+    default: /* '?' */
+      usage();
+      break;
+    }
+  }
+  if (nb_events == 0 || (sweep && rate == 0) || strspn(types, type_chars) != strlen(types) || types[0] == '\0') {
+    usage();
+  }
+  return 0;
+}
+
+static void destroy_devices() {
+  unsigned int i;
+  for (i = 0; i < NB_DEVICES; ++i) {
+    destroy_device(devices + i);
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  read_args(argc, argv);
+
+  int mkb = 0;
+  unsigned int i;
+  for (i = 0; i < NB_DEVICES; ++i) {
+    if (strchr(types, type_chars[i]) == NULL) {
+      continue;
+    }
+    if (create_device(devices + i) < 0) {
+      destroy_devices();
+      return EXIT_FAILURE;
+    }
+    if (devices[i].type != GE_DEVICE_JOYSTICK) {
+      mkb = 1;
+    }
+  }
+
+  // let udev create the device nodes
+  sleep(1);
+
+  if ((evdev && ginput_set_joystick_backend(GE_JOYSTICK_BACKEND_EVDEV) < 0)
+      || ginput_init(NULL, mkb ? GE_MKB_SOURCE_PHYSICAL : GE_MKB_SOURCE_NONE, process_event) < 0) {
+    destroy_devices();
+    return EXIT_FAILURE;
+  }
+
+  int ret = 0;
+  for (i = 0; i < NB_DEVICES; ++i) {
+    if (devices[i].uinput >= 0 && find_device(devices + i) < 0) {
+      ret = -1;
+    }
+  }
+
+  if (ret == 0) {
+
+    // the initial state of the joysticks
+    drain(200000000LL);
+  }
+
+  if (ret == 0) {
+
+    printf("joystick backend: %s, %u events per step\n", evdev ? "evdev" : "js", nb_events);
+    printf("%-9s %9s %10s %9s %9s %9s %9s %9s %9s\n", "device", "rate", "achieved", "delivered", "lost", "overflows",
+        "p50 (us)", "p99 (us)", "max (us)");
+
+    for (i = 0; i < NB_DEVICES; ++i) {
+      if (devices[i].uinput >= 0) {
+        bench(devices + i);
+      }
+    }
+  }
+
+  ginput_quit();
+
+  destroy_devices();
+
+  return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}